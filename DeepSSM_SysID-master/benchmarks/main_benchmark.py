@@ -0,0 +1,230 @@
+# import generic libraries
+import torch
+import numpy as np
+import itertools
+import multiprocessing as mp
+import resource
+import platform
+import json
+import time
+import os
+import sys
+
+os.chdir('../')
+sys.path.append(os.getcwd())
+# import user-written files
+from models.model_state import ModelState
+# import options files
+import options.model_options as model_params
+import options.dataset_options as dynsys_params
+import options.train_options as train_params
+
+"""benchmark of the compute cost of all models in DynamicModel. Every configuration (model, dataset, batch size,
+sequence length, number of threads) runs in its own forked process such that the peak RSS is not polluted by the
+previous configurations. The results are written as json and compared against a stored baseline."""
+
+
+# %%####################################################################################################################
+# single configuration, runs in a fresh process
+########################################################################################################################
+def run_config(config):
+    model, dataset, batch_size, seq_len, threads, benchopts = config
+    rss_start = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+
+    # reproducible setting
+    torch.set_num_threads(threads)
+    np.random.seed(benchopts['seed'])
+
+    # get the options of the dataset (model sizes from options/model_options.py)
+    options = {'model': model, 'dataset': dataset, 'device': torch.device('cpu'), 'optim': 'Adam'}
+    options['dataset_options'] = dynsys_params.get_dataset_options(dataset)
+    options['model_options'] = model_params.get_model_options(model, dataset, options['dataset_options'])
+    options['train_options'] = train_params.get_train_options(dataset)
+    nu = options['dataset_options'].u_dim
+    ny = options['dataset_options'].y_dim
+
+    # define model
+    modelstate = ModelState(seed=benchopts['seed'], nu=nu, ny=ny, model=model, options=options)
+    modelstate.model.to(options['device'])
+
+    # synthetic data of the size of one batch
+    generator = torch.Generator().manual_seed(benchopts['seed'])
+    u = torch.randn(batch_size, nu, seq_len, generator=generator)
+    y = torch.randn(batch_size, ny, seq_len, generator=generator)
+
+    def train_step():
+        modelstate.optimizer.zero_grad()
+        loss_ = modelstate.model(u, y)
+        loss_.backward()
+        modelstate.optimizer.step()
+
+    # warm up
+    modelstate.model.train()
+    for _ in range(benchopts['n_warmup']):
+        train_step()
+
+    # training steps
+    times = []
+    for _ in range(benchopts['n_repeat']):
+        start = time.perf_counter_ns()
+        for _ in range(benchopts['n_steps']):
+            train_step()
+        times.append((time.perf_counter_ns() - start) / benchopts['n_steps'])
+    step_ns = float(np.median(times))
+
+    # generation (inference) steps
+    modelstate.model.eval()
+    gen_times = []
+    with torch.no_grad():
+        for _ in range(benchopts['n_repeat']):
+            start = time.perf_counter_ns()
+            modelstate.model.generate(u)
+            gen_times.append(time.perf_counter_ns() - start)
+    gen_ns = float(np.median(gen_times))
+
+    # number of ops of one training step which allocate memory (net self allocation > 0, not the number of
+    # allocations: temporaries freed within an op are not seen, an op allocating several tensors counts once)
+    modelstate.model.train()
+    try:
+        with torch.autograd.profiler.profile(profile_memory=True) as prof:
+            train_step()
+        # self memory only, the inclusive cpu_memory_usage counts the allocations of nested ops again
+        allocating_ops_per_step = sum(1 for e in prof.function_events if e.self_cpu_memory_usage > 0)
+    except (TypeError, AttributeError, RuntimeError):
+        # profile_memory not supported by the installed torch version
+        allocating_ops_per_step = None
+
+    # peak resident set size (ru_maxrss is given in kB on Linux)
+    rss_peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+
+    return {'model': model,
+            'dataset': dataset,
+            'batch_size': batch_size,
+            'seq_len': seq_len,
+            'threads': threads,
+            'h_dim': options['model_options'].h_dim,
+            'z_dim': options['model_options'].z_dim,
+            'n_layers': options['model_options'].n_layers,
+            'steps_per_sec': 1e9 / step_ns,
+            'ns_per_timestep': step_ns / seq_len,
+            'gen_ns_per_timestep': gen_ns / seq_len,
+            'peak_rss_mb': rss_peak / 1024,
+            'peak_rss_delta_mb': (rss_peak - rss_start) / 1024,
+            'allocating_ops_per_step': allocating_ops_per_step}
+
+
+# %%####################################################################################################################
+# comparison against the stored baseline
+########################################################################################################################
+def config_key(result):
+    return result['model'], result['dataset'], result['batch_size'], result['seq_len'], result['threads']
+
+
+def compare_baseline(results, baseline, tolerance):
+    baseline = {config_key(res): res for res in baseline['results']}
+    regressions = []
+    for res in results:
+        key = config_key(res)
+        if key not in baseline:
+            continue
+        ratio = res['steps_per_sec'] / baseline[key]['steps_per_sec']
+        res['baseline_ratio'] = ratio
+        if ratio < 1 - tolerance:
+            regressions.append(res)
+            print('REGRESSION {}: {:.2f} steps/s (baseline {:.2f}, {:+.1f}%)'.format(key, res['steps_per_sec'],
+                                                                                  baseline[key]['steps_per_sec'],
+                                                                                  100 * (ratio - 1)))
+    return regressions
+
+
+# %%####################################################################################################################
+# Main function
+########################################################################################################################
+def run_main_benchmark(benchopts, path_general, file_name_general):
+    print('Run file: main_benchmark.py')
+    print(time.strftime("%c"))
+
+    # all configurations of the sweep
+    configs = [config + (benchopts,) for config in itertools.product(benchopts['models'],
+                                                                     benchopts['datasets'],
+                                                                     benchopts['batch_sizes'],
+                                                                     benchopts['seq_lens'],
+                                                                     benchopts['threads'])]
+    print('Total number of configurations: {}'.format(len(configs)))
+
+    # each configuration in a fresh process
+    results = []
+    ctx = mp.get_context('fork')
+    with ctx.Pool(processes=1, maxtasksperchild=1) as pool:
+        for res in pool.imap(run_config, configs):
+            print('{:>12s} {:>18s} batch={:5d} seq_len={:5d} threads={:3d}: {:9.2f} steps/s, {:10.0f} ns/timestep, '
+                  '{:8.1f} MB peak RSS'.format(res['model'], res['dataset'], res['batch_size'], res['seq_len'],
+                                               res['threads'], res['steps_per_sec'], res['ns_per_timestep'],
+                                               res['peak_rss_mb']))
+            results.append(res)
+
+    # compare against baseline
+    regressions = []
+    missing_baseline = False
+    if benchopts['baseline'] is not None and os.path.isfile(benchopts['baseline']):
+        with open(benchopts['baseline'], 'r') as f:
+            baseline = json.load(f)
+        regressions = compare_baseline(results, baseline, benchopts['tolerance'])
+        print('Regressions against baseline: {}'.format(len(regressions)))
+    elif benchopts['baseline'] is not None and not benchopts['save_baseline']:
+        # the baseline depends on the machine, it is not part of the repository
+        missing_baseline = True
+        print('WARNING: no baseline found at {}, nothing was compared. Run once with save_baseline=True on this '
+              'machine to store one.'.format(benchopts['baseline']), file=sys.stderr)
+
+    # save data
+    output = {'environment': {'torch': torch.__version__,
+                              'python': platform.python_version(),
+                              'platform': platform.platform(),
+                              'processor': platform.processor(),
+                              'cpu_count': os.cpu_count()},
+              'options': {k: v for k, v in benchopts.items()},
+              'results': results,
+              'regressions': [config_key(res) for res in regressions]}
+    # check if path exists and create otherwise
+    if not os.path.exists(path_general):
+        os.makedirs(path_general)
+    with open(path_general + file_name_general + '.json', 'w') as f:
+        json.dump(output, f, indent=1)
+    # store as new baseline
+    if benchopts['save_baseline'] and benchopts['baseline'] is not None:
+        path = os.path.dirname(benchopts['baseline'])
+        if not os.path.exists(path):
+            os.makedirs(path)
+        with open(benchopts['baseline'], 'w') as f:
+            json.dump(output, f, indent=1)
+
+    return len(regressions) == 0 and not missing_baseline
+
+
+# %%
+if __name__ == "__main__":
+    # set benchmark options dictionary
+    benchopts = {
+        'models': ['VAE-RNN', 'VRNN-Gauss-I', 'VRNN-Gauss', 'VRNN-GMM-I', 'VRNN-GMM', 'STORN'],
+        'datasets': ['narendra_li', 'toy_lgssm', 'wiener_hammerstein'],
+        'batch_sizes': [1, 32, 128],
+        'seq_lens': [64, 512, 2048],
+        'threads': [1, 4],
+        'n_warmup': 2,
+        'n_steps': 3,
+        'n_repeat': 5,
+        'seed': 1234,
+        'baseline': os.getcwd() + '/benchmarks/baselines/baseline.json',
+        'save_baseline': False,  # overwrite the stored baseline with the results of this run
+        'tolerance': 0.1,  # allowed relative slowdown in steps/s before reporting a regression
+    }
+
+    # get saving path
+    path_general = os.getcwd() + '/log/benchmark/'
+
+    # get saving file names
+    file_name_general = 'benchmark_' + time.strftime("%Y%m%d_%H%M%S")
+
+    ok = run_main_benchmark(benchopts, path_general, file_name_general)
+    sys.exit(0 if ok else 1)
@@ -0,0 +1,155 @@
+# import generic libraries
+import torch
+import numpy as np
+import timeit
+import platform
+import json
+import time
+import os
+import sys
+
+os.chdir('../')
+sys.path.append(os.getcwd())
+
+"""microbenchmark of the hot methods of the eight tensor types (Byte, Char, Short, Int, Long, Half, Float, Double) which
+are generated from generic/Tensor.cpp. All calls go through the python wrapper, such that the measured time is the
+cost a model pays per call. The model time = overhead + bytes * cost per tensor type and method shows where the
+fixed per-call overhead dominates, which is the case for the small tensors of our models."""
+
+# the eight generated tensor types
+TENSOR_TYPES = {'Byte': torch.uint8,
+                'Char': torch.int8,
+                'Short': torch.int16,
+                'Int': torch.int32,
+                'Long': torch.int64,
+                'Half': torch.float16,
+                'Float': torch.float32,
+                'Double': torch.float64}
+
+
+def time_call(fn, min_time):
+    # time per call in ns with automatically chosen number of calls
+    timer = timeit.Timer(fn)
+    number, _ = timer.autorange()
+    number = max(1, int(number * min_time / 0.2))
+    return 1e9 * min(timer.repeat(repeat=3, number=number)) / number
+
+
+def get_methods(t, numel):
+    # source tensors are allocated outside of the timed region
+    src_same = torch.ones_like(t)
+    src_cross = torch.ones(t.shape, dtype=torch.float32 if t.dtype != torch.float32 else torch.float64)
+    idx = torch.randint(0, max(numel, 1), (max(numel // 16, 1),), dtype=torch.int64)
+    flat = t.view(-1)
+    half = max(numel // 2, 1)
+
+    return {'call': lambda: t.dim(),  # pure python boundary, no work on data
+            'fill': lambda: t.fill_(1),
+            'copy': lambda: t.copy_(src_same),
+            'copy_cross': lambda: t.copy_(src_cross),
+            'index': lambda: flat[half - 1],
+            'index_tensor': lambda: flat[idx],
+            'slice': lambda: flat[:half],
+            'slice_copy': lambda: flat[:half].clone()}
+
+
+def fit_overhead(sizes_bytes, times_ns, small_bytes=1024):
+    # model time = overhead + bytes * cost; a least squares fit over sizes from 0 B to 100 MB only sees the large
+    # sizes, hence the two parameters are taken where they dominate: the overhead from the small sizes (<= small_bytes,
+    # scalar included) and the cost per byte from the larger half of the sizes
+    sizes_bytes = np.asarray(sizes_bytes, dtype=np.float64)
+    times_ns = np.asarray(times_ns, dtype=np.float64)
+    order = np.argsort(sizes_bytes)
+    sizes_bytes, times_ns = sizes_bytes[order], times_ns[order]
+    small = sizes_bytes <= max(small_bytes, sizes_bytes[0])
+    overhead = float(np.median(times_ns[small]))
+    large = (np.arange(len(sizes_bytes)) >= len(sizes_bytes) // 2) & (sizes_bytes > 0) & ~small
+    if not np.any(large):
+        return overhead, 0., float('inf')
+    cost = float(np.median((times_ns[large] - overhead) / sizes_bytes[large]))
+    # size where the per-byte work equals the fixed overhead
+    crossover = overhead / cost if cost > 0 else float('inf')
+    return overhead, cost, crossover
+
+
+# %%####################################################################################################################
+# Main function
+########################################################################################################################
+def run_main_tensor_microbenchmark(benchopts, path_general, file_name_general):
+    print('Run file: main_tensor_microbenchmark.py')
+    print(time.strftime("%c"))
+    torch.set_num_threads(benchopts['threads'])
+
+    results = []
+    summary = {}
+    for type_name, dtype in TENSOR_TYPES.items():
+        elem_size = torch.tensor([], dtype=dtype).element_size()
+        times = {}
+        for size_bytes in benchopts['sizes_bytes']:
+            # size 0 is a scalar (0-dim) tensor
+            numel = max(size_bytes // elem_size, 1)
+            t = torch.zeros((), dtype=dtype) if size_bytes == 0 else torch.zeros(numel, dtype=dtype)
+            for method, fn in get_methods(t, numel).items():
+                try:
+                    time_ns = time_call(fn, benchopts['min_time'])
+                except RuntimeError:
+                    # method not implemented for this tensor type on the cpu
+                    continue
+                results.append({'type': type_name,
+                                'method': method,
+                                'bytes': numel * elem_size,
+                                'numel': numel,
+                                'ns_per_call': time_ns,
+                                'ns_per_elem': time_ns / numel})
+                times.setdefault(method, []).append((numel * elem_size, time_ns))
+            del t
+
+        # per-call overhead vs. per-byte cost
+        for method, values in times.items():
+            if len(values) < 2:
+                continue
+            overhead, cost, crossover = fit_overhead(*zip(*values))
+            summary['{}.{}'.format(type_name, method)] = {'overhead_ns': overhead,
+                                                          'ns_per_byte': cost,
+                                                          'crossover_bytes': crossover}
+
+    # print the overhead table
+    print('{:>22s} {:>14s} {:>14s} {:>16s}'.format('type.method', 'overhead [ns]', 'cost [ns/kB]', 'crossover [kB]'))
+    for name, s in summary.items():
+        print('{:>22s} {:14.0f} {:14.3f} {:16.1f}'.format(name, s['overhead_ns'], 1e3 * s['ns_per_byte'],
+                                                           s['crossover_bytes'] / 1e3))
+
+    # save data
+    output = {'environment': {'torch': torch.__version__,
+                              'python': platform.python_version(),
+                              'platform': platform.platform(),
+                              'cpu_count': os.cpu_count()},
+              'options': benchopts,
+              'results': results,
+              'summary': summary}
+    # check if path exists and create otherwise
+    if not os.path.exists(path_general):
+        os.makedirs(path_general)
+    with open(path_general + file_name_general + '.json', 'w') as f:
+        json.dump(output, f, indent=1)
+
+    return output
+
+
+# %%
+if __name__ == "__main__":
+    # set benchmark options dictionary
+    benchopts = {
+        # from scalar up to 100 MB
+        'sizes_bytes': [0, 64, 1024, 16 * 1024, 256 * 1024, 4 * 1024 ** 2, 100 * 1024 ** 2],
+        'min_time': 0.05,  # minimal time per measurement [s]
+        'threads': 1,
+    }
+
+    # get saving path
+    path_general = os.getcwd() + '/log/benchmark/'
+
+    # get saving file names
+    file_name_general = 'tensor_microbenchmark_' + time.strftime("%Y%m%d_%H%M%S")
+
+    run_main_tensor_microbenchmark(benchopts, path_general, file_name_general)
@@ -35,6 +35,16 @@ class IODataset(Dataset):
         self.nu = 1 if u.ndim == 1 else u.shape[1]
         self.ny = 1 if y.ndim == 1 else y.shape[1]
 
+    @classmethod
+    def from_batches(cls, u, y):
+        # dataset from already batchified u, y: (number of batches, number of signals, seq_len), e.g. cached arrays
+        dataset = cls.__new__(cls)
+        dataset.u = u
+        dataset.y = y
+        dataset.ntotbatch, dataset.nu, dataset.seq_len = u.shape
+        dataset.ny = y.shape[1]
+        return dataset
+
     def __len__(self):
         return self.ntotbatch
 
@@ -0,0 +1,123 @@
+import os
+import json
+import fcntl
+import shutil
+import hashlib
+import numpy as np
+from data.base import IODataset
+
+"""content-addressed cache of generated (random) training and validation sets. The key is the hash of the generator
+parameters (generator, k_max_*, noise levels, seq_len_*) and of the seed, i.e. a cached set is exactly the set that
+would be generated. Only seeded sets are cached (the unseeded numpy state differs in every process), hence all runs
+with the same seed (e.g. all grid points, or one Monte Carlo iteration of every script) share their data. The state of the
+random generator after the generation is stored as well and restored on a hit, such that everything drawn afterwards
+(e.g. the noise of the test set) stays the same. An entry is a directory of .npy files with the batchified float32
+u / y, loaded with np.load(mmap_mode='c') (the pages are shared by all processes). Entries are written to a temporary
+directory and renamed, hence parallel workers never see half-written entries. The least recently used entries are
+removed once the cache is larger than max_bytes. An entry evicted while it is read counts as a miss."""
+
+
+class DatasetCache(object):
+    def __init__(self, path='data/cache/', max_bytes=2 * 1024 ** 3):
+        self.path = path
+        self.max_bytes = max_bytes
+        os.makedirs(path, exist_ok=True)
+
+    @staticmethod
+    def key(params, rng_state=None):
+        h = hashlib.sha1(json.dumps(params, sort_keys=True).encode())
+        if rng_state is not None:
+            name, keys, pos, has_gauss, cached_gaussian = rng_state
+            h.update(np.asarray(keys, dtype=np.uint32).tobytes())
+            h.update(json.dumps([name, int(pos), int(has_gauss), float(cached_gaussian)]).encode())
+        return h.hexdigest()
+
+    def get(self, key):
+        # dict name -> array or None
+        entry = os.path.join(self.path, key)
+        try:
+            arrays = {file[:-4]: np.load(os.path.join(entry, file), mmap_mode='c')
+                      for file in os.listdir(entry) if file.endswith('.npy')}
+            # last use for the LRU eviction
+            os.utime(entry)
+        except (OSError, ValueError):
+            # not cached or just evicted
+            return None
+        return arrays
+
+    def put(self, key, arrays):
+        entry = os.path.join(self.path, key)
+        tmp = os.path.join(self.path, '.tmp_{}_{}'.format(key, os.getpid()))
+        os.makedirs(tmp, exist_ok=True)
+        for name, array in arrays.items():
+            np.save(os.path.join(tmp, name + '.npy'), array)
+        try:
+            os.rename(tmp, entry)
+        except OSError:
+            # written by another process in the meantime
+            shutil.rmtree(tmp, ignore_errors=True)
+        self.evict()
+
+    def evict(self):
+        with open(os.path.join(self.path, '.lock'), 'a') as lock:
+            fcntl.flock(lock, fcntl.LOCK_EX)
+            entries = []
+            for name in os.listdir(self.path):
+                entry = os.path.join(self.path, name)
+                if name.startswith('.') or not os.path.isdir(entry):
+                    continue
+                try:
+                    size = sum(os.path.getsize(os.path.join(entry, file)) for file in os.listdir(entry))
+                    entries.append((os.path.getmtime(entry), size, entry))
+                except FileNotFoundError:
+                    continue
+            total = sum(size for _, size, _ in entries)
+            # oldest first, processes which still map the files keep them until they are done
+            for _, size, entry in sorted(entries):
+                if total <= self.max_bytes:
+                    break
+                shutil.rmtree(entry, ignore_errors=True)
+                total -= size
+            fcntl.flock(lock, fcntl.LOCK_UN)
+
+
+def _rng_state_arrays(rng_state):
+    name, keys, pos, has_gauss, cached_gaussian = rng_state
+    return {'rng_keys': np.asarray(keys, dtype=np.uint32),
+            'rng_params': np.array([pos, has_gauss, cached_gaussian], dtype=np.float64)}
+
+
+def _rng_state(arrays):
+    pos, has_gauss, cached_gaussian = arrays['rng_params']
+    return 'MT19937', np.array(arrays['rng_keys']), int(pos), int(has_gauss), float(cached_gaussian)
+
+
+def cached_datasets(params, generate, seq_len_train=None, seq_len_val=None, seed=None, cache=True):
+    # params: generator parameters, generate(): returns u_train, y_train, u_val, y_val, shape (total_len, n_channels)
+    # cache: True (default cache), a DatasetCache or False (always generate); returns dataset_train, dataset_val
+    if seed is not None:
+        np.random.seed(seed)
+    if cache is False or seed is None:
+        u_train, y_train, u_val, y_val = generate()
+        return IODataset(u_train, y_train, seq_len_train), IODataset(u_val, y_val, seq_len_val)
+    cache = DatasetCache() if cache is True else cache
+    params = dict(params, seq_len_train=seq_len_train, seq_len_val=seq_len_val, seed=seed)
+    key = cache.key(params, np.random.get_state())
+
+    arrays = cache.get(key)
+    try:
+        if arrays is not None:
+            datasets = (IODataset.from_batches(arrays['u_train'], arrays['y_train']),
+                        IODataset.from_batches(arrays['u_val'], arrays['y_val']))
+            np.random.set_state(_rng_state(arrays))
+            return datasets
+    except KeyError:
+        # partly evicted while listing the entry, generate it again
+        pass
+
+    u_train, y_train, u_val, y_val = generate()
+    dataset_train = IODataset(u_train, y_train, seq_len_train)
+    dataset_val = IODataset(u_val, y_val, seq_len_val)
+    cache.put(key, dict(_rng_state_arrays(np.random.get_state()),
+                        u_train=dataset_train.u, y_train=dataset_train.y, u_val=dataset_val.u, y_val=dataset_val.y))
+    return dataset_train, dataset_val
@@ -0,0 +1,230 @@
+import os
+import csv
+import json
+import numpy as np
+
+"""compressed storage of long (slowly varying) signals with random access to blocks of block_size samples. Every
+channel uses one of two codecs:
+ - 'delta': measured signals are quantized (ADC) and the csv files store them with a fixed number of decimals. If all
+   values of a channel are integers after scaling with 10^decimals (checked to be exact), the differences of these
+   integers are stored (zigzag coded, one bit width per block). Slowly varying signals need few bits per sample.
+ - 'xor': otherwise the bit patterns of consecutive values are XORed as in Gorilla
+   (http://www.vldb.org/pvldb/vol8/p1816-teller.pdf): sign, exponent and leading mantissa bits cancel. Instead of the
+   per value control bits of Gorilla, groups of 8 values share the window of meaningful bits (leading / trailing
+   zeros), such that the offsets of all values follow from a cumulative sum.
+Encoding and decoding of a block are vectorized numpy (bit packing, cumulative sum / XOR), no loop over samples.
+
+File layout: magic, length of the json header, json header (n_channels, n_samples, block_size, dtype, codec and
+decimals per channel, columns), block index (n_channels, n_blocks, [offset, nbytes, first value, width]) and the
+packed blocks."""
+
+MAGIC = b'XTS1'
+GROUP = 8
+
+
+def _uint(dtype):
+    return np.uint64 if np.dtype(dtype).itemsize == 8 else np.uint32
+
+
+def _bit_length(v):
+    # number of bits of every element of the uint64 array v
+    v = v.copy()
+    n = np.zeros(v.shape, dtype=np.int64)
+    for s in (32, 16, 8, 4, 2, 1):
+        m = v >= (np.uint64(1) << np.uint64(s))
+        n += s * m
+        v[m] >>= np.uint64(s)
+    return n + (v > 0)
+
+
+def _pack(v, widths):
+    # bit stream of the values v (uint64) with widths[i] bits each (most significant bit first); every value covers at
+    # most 9 bytes of the stream, the bits of different values are disjoint, hence the bytes are sums (bincount)
+    widths = np.asarray(widths, dtype=np.int64)
+    offsets = np.cumsum(widths) - widths
+    n_bytes = -(-int(widths.sum()) // 8)
+    r = (offsets & 7).astype(np.uint64)
+    aligned = np.where(widths > 0, v << (64 - widths).astype(np.uint64) % np.uint64(64), np.uint64(0))
+    hi = aligned >> r
+    lo = np.where(r > 0, (aligned << (np.uint64(8) - r)) & np.uint64(255), np.uint64(0))
+    parts = np.concatenate([(hi[:, None] >> np.arange(56, -1, -8, dtype=np.uint64)) & np.uint64(255),
+                            lo[:, None]], axis=1)
+    idx = (offsets >> 3)[:, None] + np.arange(9)
+    stream = np.bincount(idx.reshape(-1), weights=parts.reshape(-1).astype(np.float64), minlength=n_bytes + 9)
+    return stream[:n_bytes].astype(np.uint8).tobytes()
+
+
+def _unpack(packed, widths):
+    # inverse of _pack: every value is read from the (unaligned, big endian) 8 bytes at its offset plus one byte
+    widths = np.asarray(widths, dtype=np.int64)
+    offsets = np.cumsum(widths) - widths
+    buffer = np.zeros(len(packed) + 16, dtype=np.uint8)
+    buffer[:len(packed)] = packed
+    words = np.ndarray(shape=(len(buffer) - 8,), dtype='>u8', buffer=buffer, strides=(1,))
+    byte = offsets >> 3
+    r = (offsets & 7).astype(np.uint64)
+    v = (words[byte].astype(np.uint64) << r) | (buffer[byte + 8].astype(np.uint64) >> (np.uint64(8) - r))
+    return np.where(widths > 0, v >> (64 - widths).astype(np.uint64) % np.uint64(64), np.uint64(0))
+
+
+# %% codecs of one block, return (first value, width, packed bytes)
+def _encode_delta(k):
+    # k: int64 values
+    d = np.diff(k)
+    zigzag = ((d << 1) ^ (d >> 63)).view(np.uint64)
+    width = int(_bit_length(np.bitwise_or.reduce(zigzag, keepdims=True))[0]) if zigzag.size else 0
+    return int(k[0]), width, _pack(zigzag, np.full(zigzag.size, width))
+
+
+def _decode_delta(packed, n, first, width):
+    zigzag = _unpack(packed, np.full(n - 1, width))
+    d = (zigzag >> np.uint64(1)).view(np.int64) ^ -(zigzag & np.uint64(1)).view(np.int64)
+    return np.concatenate([[first], first + np.cumsum(d)])
+
+
+def _encode_xor(bits):
+    # bits: uint64 bit patterns of the values
+    xor = bits[1:] ^ bits[:-1]
+    n_groups = -(-xor.size // GROUP)
+    groups = np.zeros(n_groups * GROUP, dtype=np.uint64)
+    groups[:xor.size] = xor
+    any_bit = np.bitwise_or.reduce(groups.reshape(n_groups, GROUP), axis=1)
+    # window per group: trailing zeros and number of meaningful bits
+    tz = np.where(any_bit > 0, _bit_length(any_bit & (~any_bit + np.uint64(1))) - 1, 0)
+    width = _bit_length(any_bit) - tz
+    window = (tz << 7) | width
+    v = xor >> np.repeat(tz, GROUP)[:xor.size].astype(np.uint64)
+    header = np.packbits(((window[:, None] >> np.arange(12, -1, -1)) & 1).astype(np.uint8)).tobytes()
+    return int(bits[0]), n_groups, header + _pack(v, np.repeat(width, GROUP)[:xor.size])
+
+
+def _decode_xor(packed, n, first):
+    n_groups = -(-(n - 1) // GROUP)
+    n_header = -(-n_groups * 13 // 8)
+    window = np.unpackbits(packed[:n_header], count=n_groups * 13).reshape(n_groups, 13).astype(np.int64)
+    window = (window << np.arange(12, -1, -1)).sum(1)
+    tz = np.repeat(window >> 7, GROUP)[:n - 1]
+    width = np.repeat(window & 127, GROUP)[:n - 1]
+    xor = _unpack(packed[n_header:], width) << tz.astype(np.uint64)
+    return np.bitwise_xor.accumulate(np.concatenate([[np.uint64(first)], xor]))
+
+
+def _decimals(x, max_decimals=9):
+    # smallest number of decimals which represents all values exactly, None if there is none
+    for decimals in range(max_decimals + 1):
+        with np.errstate(invalid='ignore', over='ignore'):
+            k = np.round(x * 10.0 ** decimals)
+            if np.all(np.abs(k) < 2 ** 62) and np.array_equal(k / 10.0 ** decimals, x) and \
+                    np.array_equal(np.signbit(k), np.signbit(x)):
+                return decimals
+    return None
+
+
+def write_timeseries(file_name, x, block_size=4096, dtype='float64', columns=None):
+    # x: ndarray, shape (total_len, n_channels) or (total_len,)
+    x = np.asarray(x, dtype=dtype)
+    x = x[:, None] if x.ndim == 1 else x
+    n_samples, n_channels = x.shape
+    n_blocks = -(-n_samples // block_size)
+    index = np.zeros([n_channels, n_blocks, 4], dtype=np.int64)
+    codecs = []
+    payload = []
+    offset = 0
+    for c in range(n_channels):
+        channel = np.ascontiguousarray(x[:, c])
+        decimals = _decimals(channel.astype(np.float64)) if dtype == 'float64' else None
+        if decimals is not None:
+            codecs.append(['delta', decimals])
+            channel = np.round(channel * 10.0 ** decimals).astype(np.int64)
+        else:
+            codecs.append(['xor', None])
+            channel = channel.view(_uint(dtype)).astype(np.uint64)
+        for k in range(n_blocks):
+            block = channel[k * block_size:(k + 1) * block_size]
+            if decimals is not None:
+                first, width, packed = _encode_delta(block)
+            else:
+                first, width, packed = _encode_xor(block)
+            index[c, k] = [offset, len(packed), np.uint64(first % 2 ** 64).view(np.int64), width]
+            payload.append(packed)
+            offset += len(packed)
+
+    header = json.dumps({'n_channels': n_channels, 'n_samples': n_samples, 'block_size': block_size,
+                         'dtype': np.dtype(dtype).name, 'codecs': codecs, 'columns': columns}).encode()
+    with open(file_name, 'wb') as file:
+        file.write(MAGIC)
+        file.write(np.uint32(len(header)).tobytes())
+        file.write(header)
+        file.write(index.tobytes())
+        file.write(b''.join(payload))
+
+
+class CompressedTimeSeries(object):
+    def __init__(self, file_name):
+        self.data = np.memmap(file_name, dtype=np.uint8, mode='r')
+        if self.data[:4].tobytes() != MAGIC:
+            raise Exception("Not a compressed time series: {}".format(file_name))
+        header_len = int(self.data[4:8].view(np.uint32)[0])
+        header = json.loads(self.data[8:8 + header_len].tobytes())
+        self.n_channels = header['n_channels']
+        self.n_samples = header['n_samples']
+        self.block_size = header['block_size']
+        self.dtype = np.dtype(header['dtype'])
+        self.codecs = header['codecs']
+        self.columns = header['columns']
+        n_blocks = -(-self.n_samples // self.block_size)
+        start = 8 + header_len
+        self.index = self.data[start:start + self.n_channels * n_blocks * 32].view(np.int64) \
+            .reshape(self.n_channels, n_blocks, 4)
+        self.payload_start = start + self.index.nbytes
+
+    def __len__(self):
+        return self.n_samples
+
+    def _decode_block(self, channel, k):
+        offset, nbytes, first, width = [int(value) for value in self.index[channel, k]]
+        n = min(self.block_size, self.n_samples - k * self.block_size)
+        packed = self.data[self.payload_start + offset:self.payload_start + offset + nbytes]
+        codec, decimals = self.codecs[channel]
+        if codec == 'delta':
+            return _decode_delta(packed, n, first, width) / 10.0 ** decimals
+        bits = _decode_xor(packed, n, np.int64(first).view(np.uint64))
+        return bits.astype(_uint(self.dtype)).view(self.dtype)
+
+    def read(self, start=0, stop=None, channels=None, dtype=None):
+        # samples start ... stop - 1 of the channels, shape (n_channels, stop - start); only the blocks containing
+        # the range are read and decoded
+        stop = self.n_samples if stop is None else min(stop, self.n_samples)
+        channels = range(self.n_channels) if channels is None else channels
+        out = np.empty([len(channels), stop - start], dtype=self.dtype if dtype is None else dtype)
+        for k in range(start // self.block_size, -(-stop // self.block_size)):
+            k_start = k * self.block_size
+            t0 = max(start, k_start)
+            t1 = min(stop, k_start + self.block_size)
+            for i, c in enumerate(channels):
+                out[i, t0 - start:t1 - start] = self._decode_block(c, k)[t0 - k_start:t1 - k_start]
+        return out
+
+    def windows(self, seq_len, channels=None, start=0, stop=None, dtype=np.float32):
+        # layout of IODataset: (number of windows, n_channels, seq_len) of consecutive windows, the rest is dropped
+        stop = self.n_samples if stop is None else min(stop, self.n_samples)
+        n_windows = (stop - start) // seq_len
+        x = self.read(start, start + n_windows * seq_len, channels, dtype)
+        return x.reshape(x.shape[0], n_windows, seq_len).transpose(1, 0, 2)
+
+
+def read_csv_columns(file_name, block_size=4096):
+    # all columns of a csv file with header line as (n_rows, n_columns); the first read stores a compressed copy
+    # (<file_name>.xts) which is used afterwards
+    compressed_file = os.path.splitext(file_name)[0] + '.xts'
+    if os.path.isfile(compressed_file) and os.path.getmtime(compressed_file) >= os.path.getmtime(file_name):
+        return CompressedTimeSeries(compressed_file).read().T
+    with open(file_name, 'r') as csv_file:
+        csv_reader = csv.reader(csv_file)
+        columns = next(csv_reader)
+        x = np.array([[float(value) for value in row] for row in csv_reader])
+    # written to a temporary file and renamed, parallel workers never see a half-written copy
+    tmp = '{}.tmp_{}'.format(compressed_file, os.getpid())
+    write_timeseries(tmp, x, block_size, columns=columns)
+    os.replace(tmp, compressed_file)
+    return x
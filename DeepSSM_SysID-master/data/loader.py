@@ -29,6 +29,7 @@ def load_dataset(dataset, dataset_options, train_batch_size, test_batch_size, **
         dataset_train, dataset_valid, dataset_test = create_narendra_li_datasets(dataset_options.seq_len_train,
                                                                                  dataset_options.seq_len_val,
                                                                                  dataset_options.seq_len_test,
+                                                                                 cache=dataset_options.cache,
                                                                                  **kwargs)
         # Dataloader
         loader_train = DataLoaderExt(dataset_train, batch_size=train_batch_size, shuffle=True, num_workers=1)
@@ -38,6 +39,7 @@ def load_dataset(dataset, dataset_options, train_batch_size, test_batch_size, **
         dataset_train, dataset_valid, dataset_test = create_toy_lgssm_datasets(dataset_options.seq_len_train,
                                                                                dataset_options.seq_len_val,
                                                                                dataset_options.seq_len_test,
+                                                                               cache=dataset_options.cache,
                                                                                **kwargs)
         # Dataloader
         loader_train = DataLoaderExt(dataset_train, batch_size=train_batch_size, shuffle=True, num_workers=1)
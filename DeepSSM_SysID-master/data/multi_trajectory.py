@@ -0,0 +1,89 @@
+import numpy as np
+from torch.utils.data import Dataset
+
+"""dataset of several independent experiments (trajectories) of different length. IODataset cuts one contiguous signal
+into consecutive windows, concatenating experiments would create windows which run over the end of one experiment into
+the next one. Here every window lies within one trajectory: long trajectories are cut into full windows of seq_len
+samples (index of (trajectory, offset)), the remaining tails and the experiments shorter than seq_len are packed into
+slots of seq_len samples (first fit decreasing, few padded samples). Every slot has a mask:
+ - MASK_RESET: first sample of a trajectory, the recurrent models set their state to zero before this sample
+ - MASK_DATA: sample of the same trajectory as the sample before
+ - MASK_PAD: padding at the end of a slot, not counted in the loss
+Items are (u, y, mask), the training loop passes the mask to the model."""
+
+MASK_PAD = 0
+MASK_DATA = 1
+MASK_RESET = 2
+
+
+class MultiTrajectoryDataset(Dataset):
+    """Create dataset from several trajectories.
+    Parameters
+    ----------
+    trajectories: list of (u, y), ndarray, shape (len, n_channels) or (len,)
+        Input and output signals of every experiment, the lengths may differ.
+    seq_len: int
+        Length of the windows / slots.
+    min_len: int (optional)
+        Tails and experiments shorter than min_len are dropped.
+    """
+    def __init__(self, trajectories, seq_len, min_len=1):
+        u_first, y_first = trajectories[0]
+        self.nu = 1 if u_first.ndim == 1 else u_first.shape[1]
+        self.ny = 1 if y_first.ndim == 1 else y_first.shape[1]
+        self.seq_len = seq_len
+        lengths = np.array([len(u) for u, _ in trajectories])
+        if any(len(u) != len(y) for u, y in trajectories):
+            raise Exception("Input and output of a trajectory differ in length")
+
+        # full windows: (trajectory, offset)
+        n_full = lengths // seq_len
+        trajectory = np.repeat(np.arange(len(trajectories)), n_full)
+        offset = (np.arange(n_full.sum()) - np.repeat(np.cumsum(n_full) - n_full, n_full)) * seq_len
+        windows = np.stack([np.arange(len(trajectory)), trajectory, offset, np.zeros_like(offset),
+                            np.full_like(offset, seq_len)], axis=1)
+
+        # tails and short experiments: (trajectory, offset, length), packed into the remaining slots
+        tails = [(k, n_full[k] * seq_len, lengths[k] - n_full[k] * seq_len) for k in range(len(trajectories))
+                 if lengths[k] - n_full[k] * seq_len >= min_len]
+        packed = self._pack(tails, seq_len, first_slot=len(windows))
+
+        # index of all pieces: (slot, trajectory, offset in the trajectory, position in the slot, length)
+        self.index = np.concatenate([windows, packed]).astype(np.int64).reshape(-1, 5)
+        self.ntotbatch = int(self.index[:, 0].max()) + 1 if len(self.index) > 0 else 0
+
+        self.u = np.zeros([self.ntotbatch, self.nu, seq_len], dtype=np.float32)
+        self.y = np.zeros([self.ntotbatch, self.ny, seq_len], dtype=np.float32)
+        self.mask = np.full([self.ntotbatch, seq_len], MASK_PAD, dtype=np.int8)
+        for slot, k, start, position, length in self.index:
+            u, y = trajectories[k]
+            u = u.reshape(len(u), -1)
+            y = y.reshape(len(y), -1)
+            self.u[slot, :, position:position + length] = u[start:start + length].T
+            self.y[slot, :, position:position + length] = y[start:start + length].T
+            self.mask[slot, position:position + length] = MASK_DATA
+            self.mask[slot, position] = MASK_RESET
+
+    @staticmethod
+    def _pack(pieces, seq_len, first_slot=0):
+        # first fit decreasing: longest piece first, into the first slot with enough space
+        free = []
+        packed = []
+        for k, start, length in sorted(pieces, key=lambda piece: -piece[2]):
+            slot = next((i for i, space in enumerate(free) if space >= length), len(free))
+            if slot == len(free):
+                free.append(seq_len)
+            packed.append((first_slot + slot, k, start, seq_len - free[slot], length))
+            free[slot] -= length
+        return np.array(packed, dtype=np.int64).reshape(-1, 5)
+
+    @property
+    def fill_rate(self):
+        # share of the samples which are not padding
+        return float(np.mean(self.mask != MASK_PAD)) if self.ntotbatch > 0 else 0.
+
+    def __len__(self):
+        return self.ntotbatch
+
+    def __getitem__(self, idx):
+        return self.u[idx, ...], self.y[idx, ...], self.mask[idx, ...]
@@ -2,6 +2,7 @@ import matplotlib.pyplot as plt
 import torch
 import numpy as np
 from data.base import IODataset
+from data.cache import cached_datasets
 
 
 def run_narendra_li_sim(u):
@@ -31,7 +32,7 @@ def run_narendra_li_sim(u):
     return y
 
 
-def create_narendra_li_datasets(seq_len_train=None, seq_len_val=None, seq_len_test=None, **kwargs):
+def create_narendra_li_datasets(seq_len_train=None, seq_len_val=None, seq_len_test=None, cache=True, **kwargs):
     # define output noise
     sigma_out = np.sqrt(0.1)
 
@@ -46,28 +47,28 @@ def create_narendra_li_datasets(seq_len_train=None, seq_len_val=None, seq_len_te
         k_max_val = 5000
         k_max_test = 5000
 
-    # training / validation set input
-    u_train = (np.random.rand(1, k_max_train) - 0.5) * 5
-    u_val = (np.random.rand(1, k_max_val) - 0.5) * 5
+    def generate():
+        # training / validation set input
+        u_train = (np.random.rand(1, k_max_train) - 0.5) * 5
+        u_val = (np.random.rand(1, k_max_val) - 0.5) * 5
+
+        # get the outputs
+        y_train = run_narendra_li_sim(u_train) + sigma_out * np.random.randn(1, k_max_train)
+        y_val = run_narendra_li_sim(u_val) + sigma_out * np.random.randn(1, k_max_val)
+
+        # get correct dimensions
+        return u_train.transpose(1, 0), y_train.transpose(1, 0), u_val.transpose(1, 0), y_val.transpose(1, 0)
+
+    # training / validation set, generated or from the dataset cache
+    params = {'generator': 'narendra_li', 'k_max_train': k_max_train, 'k_max_val': k_max_val, 'sigma_out': sigma_out}
+    dataset_train, dataset_val = cached_datasets(params, generate, seq_len_train, seq_len_val, kwargs.get('seed'),
+                                                 cache)
+
     # test set input
     file_path = 'data/Narendra_Li/narendra_li_testdata.npz'
     test_data = np.load(file_path)
     u_test = test_data['u_test'][0:k_max_test]
     y_test = test_data['y_test'][0:k_max_test]
-
-    # get the outputs
-    y_train = run_narendra_li_sim(u_train) + sigma_out * np.random.randn(1, k_max_train)
-    y_val = run_narendra_li_sim(u_val) + sigma_out * np.random.randn(1, k_max_val)
-
-    # get correct dimensions
-
-    u_train = u_train.transpose(1, 0)
-    y_train = y_train.transpose(1, 0)
-    u_val = u_val.transpose(1, 0)
-    y_val = y_val.transpose(1, 0)
-
-    dataset_train = IODataset(u_train, y_train, seq_len_train)
-    dataset_val = IODataset(u_val, y_val, seq_len_val)
     dataset_test = IODataset(u_test, y_test, seq_len_test)
 
     return dataset_train, dataset_val, dataset_test
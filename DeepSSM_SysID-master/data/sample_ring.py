@@ -0,0 +1,113 @@
+import time
+import numpy as np
+import torch
+
+"""bounded single-producer/single-consumer ring of (u, y) samples for live sensor data. The acquisition thread is the
+only writer of the head index, the inference thread the only writer of the tail index, hence no lock is needed.
+Both indices live on their own cache line. The samples are stored channel-major (channels, capacity) and the first
+max_span samples are mirrored behind the end of the buffer, such that every window up to max_span samples, including
+the ones wrapping around the end, is a contiguous view in the (channels, seq_len) layout of IODataset."""
+
+_CACHE_LINE = 64
+
+
+class SampleRing(object):
+    def __init__(self, capacity, nu, ny, max_span=4096, block=False, timeout=1.0):
+        if max_span > capacity:
+            raise Exception("max_span must not exceed the capacity")
+        self.capacity = capacity
+        self.nu = nu
+        self.ny = ny
+        self.max_span = max_span
+        # backpressure: block the producer when full (up to timeout), otherwise drop the new samples
+        self.block = block
+        self.timeout = timeout
+
+        # channels [0, nu) are u, [nu, nu + ny) are y
+        self.buffer = np.zeros([nu + ny, capacity + max_span], dtype=np.float32)
+        # head (written by producer) and tail (written by consumer) on separate cache lines
+        stride = _CACHE_LINE // np.dtype(np.int64).itemsize
+        self._indices = np.zeros(3 * stride, dtype=np.int64)
+        self._head = self._indices[stride:stride + 1]
+        self._tail = self._indices[2 * stride:2 * stride + 1]
+        # counters (producer side)
+        self.pushed = 0
+        self.dropped = 0
+        self.blocked = 0
+
+    def __len__(self):
+        return int(self._head[0] - self._tail[0])
+
+    def free(self):
+        return self.capacity - len(self)
+
+    # %% producer
+    def push(self, u, y):
+        # u: ndarray, shape (n_samples, nu), y: ndarray, shape (n_samples, ny); returns number of stored samples
+        u = np.asarray(u, dtype=np.float32).reshape(-1, self.nu)
+        y = np.asarray(y, dtype=np.float32).reshape(-1, self.ny)
+        n = u.shape[0]
+
+        if self.free() < n:
+            if self.block:
+                self.blocked += 1
+                deadline = time.perf_counter() + self.timeout
+                while self.free() < n and time.perf_counter() < deadline:
+                    time.sleep(0)
+            if self.free() < n:
+                # drop what does not fit
+                n_fit = self.free()
+                self.dropped += n - n_fit
+                u, y, n = u[:n_fit], y[:n_fit], n_fit
+        if n == 0:
+            return 0
+
+        head = int(self._head[0])
+        idx = (head + np.arange(n)) % self.capacity
+        self.buffer[:self.nu, idx] = u.T
+        self.buffer[self.nu:, idx] = y.T
+        # mirror the beginning of the buffer behind its end
+        mirror = idx < self.max_span
+        if mirror.any():
+            self.buffer[:, self.capacity + idx[mirror]] = self.buffer[:, idx[mirror]]
+        # publish after the data is written
+        self._head[0] = head + n
+        self.pushed += n
+        return n
+
+    # %% consumer
+    def window(self, seq_len, offset=0):
+        # zero-copy view of seq_len samples starting offset samples after the tail, shapes (nu, seq_len), (ny, seq_len)
+        if seq_len > self.max_span:
+            raise Exception("window longer than max_span")
+        if offset + seq_len > len(self):
+            return None
+        start = (int(self._tail[0]) + offset) % self.capacity
+        return self.buffer[:self.nu, start:start + seq_len], self.buffer[self.nu:, start:start + seq_len]
+
+    def windows(self, seq_len, batch_size, stride=None):
+        # zero-copy batch of windows (batch, channels, seq_len) as torch tensors, windows start every stride samples
+        stride = seq_len if stride is None else stride
+        span = (batch_size - 1) * stride + seq_len
+        if span > self.max_span:
+            raise Exception("batch of windows longer than max_span")
+        if span > len(self):
+            return None
+        start = int(self._tail[0]) % self.capacity
+        base = self.buffer[:, start:start + span]
+        s_ch, s_t = base.strides
+        batch = torch.from_numpy(np.lib.stride_tricks.as_strided(base, shape=(batch_size, self.nu + self.ny, seq_len),
+                                                                 strides=(stride * s_t, s_ch, s_t)))
+        return batch[:, :self.nu, :], batch[:, self.nu:, :]
+
+    def advance(self, n):
+        # release n samples to the producer, views obtained before must not be used afterwards
+        n = min(n, len(self))
+        self._tail[0] = int(self._tail[0]) + n
+        return n
+
+    def stats(self):
+        return {'pushed': self.pushed,
+                'dropped': self.dropped,
+                'blocked': self.blocked,
+                'fill': len(self)}
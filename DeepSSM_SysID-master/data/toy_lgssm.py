@@ -1,6 +1,7 @@
 import matplotlib.pyplot as plt
 import numpy as np
 from data.base import IODataset
+from data.cache import cached_datasets
 
 
 def run_toy_lgssm_sim(u, A, B, C, sigma_state, sigma_out):
@@ -29,7 +30,7 @@ def run_toy_lgssm_sim(u, A, B, C, sigma_state, sigma_out):
     return y
 
 
-def create_toy_lgssm_datasets(seq_len_train=None, seq_len_val=None, seq_len_test=None, **kwargs):
+def create_toy_lgssm_datasets(seq_len_train=None, seq_len_val=None, seq_len_test=None, cache=True, **kwargs):
     # state space matrices
     A = np.array([[0.7, 0.8], [0, 0.1]])
     B = np.array([[-1], [0.1]])
@@ -49,27 +50,29 @@ def create_toy_lgssm_datasets(seq_len_train=None, seq_len_val=None, seq_len_test
         k_max_val = 5000
         k_max_test = 5000
 
-    # training / validation set input
-    u_train = (np.random.rand(1, k_max_train) - 0.5) * 5
-    u_val = (np.random.rand(1, k_max_val) - 0.5) * 5
+    def generate():
+        # training / validation set input
+        u_train = (np.random.rand(1, k_max_train) - 0.5) * 5
+        u_val = (np.random.rand(1, k_max_val) - 0.5) * 5
+
+        # get the outputs
+        y_train = run_toy_lgssm_sim(u_train, A, B, C, sigma_state, 0) + sigma_out * np.random.randn(1, k_max_train)
+        y_val = run_toy_lgssm_sim(u_val, A, B, C, sigma_state, 0) + sigma_out * np.random.randn(1, k_max_val)
+
+        # get correct dimensions
+        return u_train.transpose(1, 0), y_train.transpose(1, 0), u_val.transpose(1, 0), y_val.transpose(1, 0)
+
+    # training / validation set, generated or from the dataset cache
+    params = {'generator': 'toy_lgssm', 'k_max_train': k_max_train, 'k_max_val': k_max_val,
+              'sigma_state': sigma_state, 'sigma_out': sigma_out}
+    dataset_train, dataset_val = cached_datasets(params, generate, seq_len_train, seq_len_val, kwargs.get('seed'),
+                                                 cache)
+
     # test set input
     file_path = 'data/Toy_LGSSM/toy_lgssm_testdata.npz'
     test_data = np.load(file_path)
     u_test = test_data['u_test'][0:k_max_test]
     y_test = test_data['y_test'][0:k_max_test]
-
-    # get the outputs
-    y_train = run_toy_lgssm_sim(u_train, A, B, C, sigma_state, 0) + sigma_out * np.random.randn(1, k_max_train)
-    y_val = run_toy_lgssm_sim(u_val, A, B, C, sigma_state, 0) + sigma_out * np.random.randn(1, k_max_val)
-
-    # get correct dimensions
-    u_train = u_train.transpose(1, 0)
-    y_train = y_train.transpose(1, 0)
-    u_val = u_val.transpose(1, 0)
-    y_val = y_val.transpose(1, 0)
-
-    dataset_train = IODataset(u_train, y_train, seq_len_train)
-    dataset_val = IODataset(u_val, y_val, seq_len_val)
     dataset_test = IODataset(u_test, y_test, seq_len_test)
 
     return dataset_train, dataset_val, dataset_test
@@ -1,8 +1,9 @@
-import csv
 import matplotlib.pyplot as plt
 import torch
 import numpy as np
 from data.base import IODataset
+from data.wiener_hammerstein_sim import create_simulated_data
+from data.compressed_timeseries import read_csv_columns
 
 
 def create_wienerhammerstein_datasets(seq_len_train=None, seq_len_val=None, seq_len_test=None, **kwargs):
@@ -32,55 +33,40 @@ def create_wienerhammerstein_datasets(seq_len_train=None, seq_len_val=None, seq_
         file_name_train = 'data/WienerHammersteinFiles/WH_MultisineFadeOut.csv'
     elif train_set == 'big':
         file_name_train = 'data/WienerHammersteinFiles/WH_SineSweepInput_meas.csv'
+    elif train_set == 'simulated':
+        # simulated training / validation data, options of create_simulated_data in kwargs['sim_options']
+        file_name_train = None
     file_name_test = 'data/WienerHammersteinFiles/WH_TestDataset.csv'
 
-    # initialization
-    u = []
-    y = []
-    u_val = []
-    y_val = []
-    u_test = []
-    y_test = []
-
-    # read the file into variable
-    with open(file_name_train, 'r') as csv_file:
-        csv_reader = csv.reader(csv_file)
-        line_count = 0
-        for row in csv_reader:
-            # ignore header line
-            if line_count == 0:
-                line_count += 1
+    # read the files (after the first read from a compressed copy, see data/compressed_timeseries.py)
+    if file_name_train is not None:
+        data = read_csv_columns(file_name_train)
+        # Extract combination of training / validation data
+        if file_name_train == 'data/WienerHammersteinFiles/WH_SineSweepInput_meas.csv':
+            idx = 100 + MCiter
+            u = data[:, idx]
+            y = data[:, 2 * idx]
+            u_val = data[:, idx + 1]
+            y_val = data[:, 2 * idx + 1]
+        elif file_name_train == 'data/WienerHammersteinFiles/WH_MultisineFadeOut.csv':
+            idx = 2
+            if MCiter % 2:
+                idx_add = 0
             else:
-                # Extract combination of training / validation data
-                if file_name_train == 'data/WienerHammersteinFiles/WH_SineSweepInput_meas.csv':
-                    idx = 100 + MCiter
-                    u.append(float(row[idx]))
-                    y.append(float(row[2 * idx]))
-                    u_val.append(float(row[idx + 1]))
-                    y_val.append(float(row[2 * idx + 1]))
-                elif file_name_train == 'data/WienerHammersteinFiles/WH_MultisineFadeOut.csv':
-                    idx = 2
-                    if MCiter % 2:
-                        idx_add = 0
-                    else:
-                        idx_add = 1
-                    u.append(float(row[idx + idx_add]))
-                    y.append(float(row[2 * idx + idx_add]))
-                    u_val.append(float(row[idx + 1 - idx_add]))
-                    y_val.append(float(row[2 * idx + 1 - idx_add]))
+                idx_add = 1
+            u = data[:, idx + idx_add]
+            y = data[:, 2 * idx + idx_add]
+            u_val = data[:, idx + 1 - idx_add]
+            y_val = data[:, 2 * idx + 1 - idx_add]
+    else:
+        sim_options = dict(kwargs['sim_options']) if 'sim_options' in kwargs else {}
+        seed = sim_options.pop('seed', 0)
+        u, y = create_simulated_data(seq_len_train, seed=seed + 2 * MCiter, **sim_options)
+        u_val, y_val = create_simulated_data(seq_len_val, seed=seed + 2 * MCiter + 1, **sim_options)
 
-    # read the file into variable
-    with open(file_name_test, 'r') as csv_file:
-        csv_reader = csv.reader(csv_file)
-        line_count = 0
-        for row in csv_reader:
-            # ignore header line
-            if line_count == 0:
-                line_count += 1
-            else:
-                # Extract combination of training / validation data
-                u_test.append(float(row[test_idx[0]]))  # use 2,4 for multisine
-                y_test.append(float(row[test_idx[1]]))  # use 3,5 for swept sine
+    data = read_csv_columns(file_name_test)
+    u_test = data[:, test_idx[0]]  # use 2,4 for multisine
+    y_test = data[:, test_idx[1]]  # use 3,5 for swept sine
 
     # convert from list to numpy array
     u_train = np.asarray(u)
@@ -0,0 +1,108 @@
+import os
+import numpy as np
+from concurrent.futures import ThreadPoolExecutor
+from scipy import signal
+
+"""simulator of a Wiener-Hammerstein system (LTI filter -> static nonlinearity -> LTI filter) for synthetic training
+data, structured like the Wiener-Hammerstein benchmark (http://www.nonlinearbenchmark.org): a 3rd order Chebyshev type I
+low pass, a saturating nonlinearity and a 3rd order Chebyshev type II low pass, sampled with 78125 Hz. The filters are
+cascades of second order sections, filtered with scipy.signal.sosfilt along the time axis for all realisations at once.
+Blocks of realisations are simulated in parallel threads (sosfilt runs without the GIL). Random-phase multisines and
+swept sines are the same kind of excitation as in the multisine / sweptsine test sets."""
+
+# sample rate of the benchmark data (also used in final_wiener_hammerstein), the filters and excitations are designed
+# in Hz, hence they keep their physical bandwidth
+FS = 78125
+
+
+class WienerHammersteinSystem(object):
+    def __init__(self, fs=FS, sos1=None, sos2=None, nonlinearity='saturation', gain=1.):
+        self.fs = fs
+        # first and second LTI block as second order sections
+        self.sos1 = signal.cheby1(3, 0.5, 4400, fs=fs, output='sos') if sos1 is None else sos1
+        self.sos2 = signal.cheby2(3, 40, 5000, fs=fs, output='sos') if sos2 is None else sos2
+        self.nonlinearity = nonlinearity
+        self.gain = gain
+
+    def static_nonlinearity(self, x):
+        if self.nonlinearity == 'saturation':
+            return np.tanh(self.gain * x)
+        elif self.nonlinearity == 'diode':
+            # one-sided: linear for negative inputs, saturating for positive ones
+            return np.where(x < 0, self.gain * x, np.log1p(self.gain * np.maximum(x, 0)))
+        elif self.nonlinearity == 'polynomial':
+            return x + self.gain * x ** 3
+        else:
+            raise Exception("Nonlinearity not implemented: {}".format(self.nonlinearity))
+
+    def _simulate_block(self, u):
+        x = signal.sosfilt(self.sos1, u, axis=-1)
+        return signal.sosfilt(self.sos2, self.static_nonlinearity(x), axis=-1)
+
+    def simulate(self, u, noise_std=0., n_transient=0, n_workers=None, rng=None):
+        # u: ndarray, shape (n_realisations, k_max); returns y of the same shape
+        # n_transient: for periodic inputs the last n_transient samples are simulated before u and discarded, such that
+        # the output is in steady state
+        rng = np.random if rng is None else rng
+        u = np.atleast_2d(u)
+        if n_transient > 0:
+            u = np.concatenate([u[:, -n_transient:], u], axis=-1)
+
+        n_workers = os.cpu_count() if n_workers is None else n_workers
+        blocks = np.array_split(u, min(n_workers, u.shape[0]), axis=0)
+        if len(blocks) > 1:
+            with ThreadPoolExecutor(len(blocks)) as executor:
+                y = np.concatenate(list(executor.map(self._simulate_block, blocks)), axis=0)
+        else:
+            y = self._simulate_block(u)
+
+        y = y[:, n_transient:]
+        if noise_std > 0:
+            y = y + noise_std * rng.randn(*y.shape)
+        return y
+
+
+# %% excitation signals
+def multisine(n_realisations, period_len, n_periods=1, fs=FS, f_min=0., f_max=10000., rms=1., rng=None):
+    # random-phase multisines with flat amplitude spectrum on the DFT grid in [f_min, f_max]
+    rng = np.random if rng is None else rng
+    freqs = np.fft.rfftfreq(period_len, 1 / fs)
+    excited = (freqs > 0) & (freqs >= f_min) & (freqs <= f_max)
+    spectrum = np.zeros([n_realisations, freqs.size], dtype=complex)
+    spectrum[:, excited] = np.exp(2j * np.pi * rng.rand(n_realisations, int(excited.sum())))
+    u = np.fft.irfft(spectrum, n=period_len, axis=-1)
+    u = rms * u / u.std(axis=-1, keepdims=True)
+    return np.tile(u, (1, n_periods))
+
+
+def swept_sine(n_realisations, k_max, fs=FS, f_min=10., f_max=10000., amplitude=1., method='logarithmic', rng=None):
+    # sine sweeps from f_min to f_max over k_max samples with random initial phase
+    rng = np.random if rng is None else rng
+    t = np.arange(k_max) / fs
+    phase_cos = signal.chirp(t, f0=f_min, t1=t[-1], f1=f_max, method=method, phi=0)
+    phase_sin = signal.chirp(t, f0=f_min, t1=t[-1], f1=f_max, method=method, phi=-90)
+    phi = 2 * np.pi * rng.rand(n_realisations, 1)
+    return amplitude * (np.cos(phi) * phase_cos - np.sin(phi) * phase_sin)
+
+
+# %% training data
+def create_simulated_data(seq_len=None, n_realisations=64, k_max=8192, input_type='multisine', rms=1.,
+                          noise_std=0., n_workers=None, seed=None, system=None):
+    # returns u, y: ndarray, shape (total_len,), the concatenation of all realisations
+    # every realisation is a multiple of seq_len long, hence no sequence of IODataset spans two realisations
+    rng = np.random.RandomState(seed)
+    system = WienerHammersteinSystem() if system is None else system
+    if seq_len is not None:
+        k_max = max(seq_len, k_max // seq_len * seq_len)
+
+    if input_type == 'multisine':
+        # one period in steady state per realisation
+        u = multisine(n_realisations, k_max, fs=system.fs, rms=rms, rng=rng)
+        y = system.simulate(u, noise_std=noise_std, n_transient=k_max, n_workers=n_workers, rng=rng)
+    elif input_type == 'sweptsine':
+        u = swept_sine(n_realisations, k_max, fs=system.fs, amplitude=np.sqrt(2) * rms, rng=rng)
+        y = system.simulate(u, noise_std=noise_std, n_workers=n_workers, rng=rng)
+    else:
+        raise Exception("Input type not implemented: {}".format(input_type))
+
+    return u.reshape(-1), y.reshape(-1)
@@ -17,6 +17,8 @@ import training
 import testing
 from utils.utils import compute_normalizer
 from utils.logger import set_redirects
+from utils.asha_scheduler import run_asha_gridsearch
+from utils.results_store import ResultsStore, run_row
 
 # import options files
 import options.model_options as model_params
@@ -44,6 +46,8 @@ def run_main_gridsearch(options, kwargs, gridvalues, path_general, file_name_gen
                                                               options['dataset_options'])
     options['train_options'] = train_params.get_train_options(options['dataset'])
     options['test_options'] = train_params.get_test_options()
+    # id of this invocation, the results store keeps the rows of earlier runs in the same logdir
+    options['run_id'] = '{}-{}'.format(time.strftime('%Y%m%d-%H%M%S'), os.getpid())
 
     # print model type and dynamic system type
     print('\n\tModel Type: {}'.format(options['model']))
@@ -70,67 +74,89 @@ def run_main_gridsearch(options, kwargs, gridvalues, path_general, file_name_gen
     all_likelihood = torch.zeros([len(h_values), len(z_values), len(n_values)])
     all_df = {}
 
-    for i1, h_sel in enumerate(h_values):
-        for i2, z_sel in enumerate(z_values):
-            for i3, n_sel in enumerate(n_values):
-
-                # output current choice
-                print('\nCurrent run: h={}, z={}, n={}\n'.format(h_sel, z_sel, n_sel))
-
-                # get current file names
-                file_name = file_name_general + '_h{}_z{}_n{}'.format(h_sel, z_sel, n_sel)
-
-                # set new values in options
-                options['model_options'].h_dim = h_sel
-                options['model_options'].z_dim = z_sel
-                options['model_options'].n_layers = n_sel
-
-                # Specifying datasets
-                loaders = loader.load_dataset(dataset=options["dataset"],
-                                              dataset_options=options["dataset_options"],
-                                              train_batch_size=options["train_options"].batch_size,
-                                              test_batch_size=options["test_options"].batch_size,
-                                              **kwargs)
-
-                # Compute normalizers
-                if options["normalize"]:
-                    normalizer_input, normalizer_output = compute_normalizer(loaders['train'])
-                else:
-                    normalizer_input = normalizer_output = None
-
-                # Define model
-                modelstate = ModelState(seed=options["seed"],
-                                        nu=loaders["train"].nu, ny=loaders["train"].ny,
-                                        model=options["model"],
-                                        options=options,
-                                        normalizer_input=normalizer_input,
-                                        normalizer_output=normalizer_output)
-                modelstate.model.to(options['device'])
-
-                # allocation
-                df = {}
-
-                if options['do_train']:
-                    # train the model
-                    df = training.run_train(modelstate=modelstate,
-                                            loader_train=loaders['train'],
-                                            loader_valid=loaders['valid'],
+    # asynchronous successive halving over all grid points
+    if options.get('scheduler', None) == 'asha':
+        points = [(h_sel, z_sel, n_sel) for h_sel in h_values for z_sel in z_values for n_sel in n_values]
+        asha_df = run_asha_gridsearch(options, kwargs, points, path_general, file_name_general)
+
+        for i1, h_sel in enumerate(h_values):
+            for i2, z_sel in enumerate(z_values):
+                for i3, n_sel in enumerate(n_values):
+                    df = asha_df[(h_sel, z_sel, n_sel)]
+                    # store values
+                    all_df[(i1, i2, i3)] = df
+                    if options['do_test']:
+                        # save performance values
+                        all_vaf[i1, i2, i3] = df['vaf']
+                        all_rmse[i1, i2, i3] = df['rmse'][0]
+                        all_likelihood[i1, i2, i3] = df['marginal_likeli'].item()
+    else:
+        for i1, h_sel in enumerate(h_values):
+            for i2, z_sel in enumerate(z_values):
+                for i3, n_sel in enumerate(n_values):
+
+                    # output current choice
+                    print('\nCurrent run: h={}, z={}, n={}\n'.format(h_sel, z_sel, n_sel))
+
+                    # get current file names
+                    file_name = file_name_general + '_h{}_z{}_n{}'.format(h_sel, z_sel, n_sel)
+
+                    # set new values in options
+                    options['model_options'].h_dim = h_sel
+                    options['model_options'].z_dim = z_sel
+                    options['model_options'].n_layers = n_sel
+
+                    # Specifying datasets
+                    loaders = loader.load_dataset(dataset=options["dataset"],
+                                                  dataset_options=options["dataset_options"],
+                                                  train_batch_size=options["train_options"].batch_size,
+                                                  test_batch_size=options["test_options"].batch_size,
+                                                  **kwargs)
+
+                    # Compute normalizers
+                    if options["normalize"]:
+                        normalizer_input, normalizer_output = compute_normalizer(loaders['train'])
+                    else:
+                        normalizer_input = normalizer_output = None
+
+                    # Define model
+                    modelstate = ModelState(seed=options["seed"],
+                                            nu=loaders["train"].nu, ny=loaders["train"].ny,
+                                            model=options["model"],
                                             options=options,
-                                            dataframe=df,
-                                            path_general=path_general,
-                                            file_name_general=file_name)
-
-                if options['do_test']:
-                    # test the model
-                    df = testing.run_test(options, loaders, df, path_general, file_name)
-
-                # store values
-                all_df[(i1, i2, i3)] = df
-
-                # save performance values
-                all_vaf[i1, i2, i3] = df['vaf']
-                all_rmse[i1, i2, i3] = df['rmse'][0]
-                all_likelihood[i1, i2, i3] = df['marginal_likeli'].item()
+                                            normalizer_input=normalizer_input,
+                                            normalizer_output=normalizer_output)
+                    modelstate.model.to(options['device'])
+
+                    # allocation
+                    df = {}
+
+                    if options['do_train']:
+                        # train the model
+                        df = training.run_train(modelstate=modelstate,
+                                                loader_train=loaders['train'],
+                                                loader_valid=loaders['valid'],
+                                                options=options,
+                                                dataframe=df,
+                                                path_general=path_general,
+                                                file_name_general=file_name)
+
+                    # loss curves for the results store, run_test removes them from df
+                    loss_curves = {name: df.get(name, []) for name in ('all_losses', 'all_vlosses')}
+
+                    if options['do_test']:
+                        # test the model
+                        df = testing.run_test(options, loaders, df, path_general, file_name)
+
+                    # store values
+                    all_df[(i1, i2, i3)] = df
+                    if options['do_test']:
+                        ResultsStore(path_general + 'data/results/').append(run_row(options, df, **loss_curves))
+
+                    # save performance values
+                    all_vaf[i1, i2, i3] = df['vaf']
+                    all_rmse[i1, i2, i3] = df['rmse'][0]
+                    all_likelihood[i1, i2, i3] = df['marginal_likeli'].item()
 
     # save data
     # get saving path
@@ -170,8 +196,16 @@ def run_main_gridsearch(options, kwargs, gridvalues, path_general, file_name_gen
                                                                                               z_values[j],
                                                                                               n_values[k], i, j, k))
 
-    # plot results
-    dv.plot_perf_gridsearch(all_vaf, all_rmse, all_likelihood, z_values, h_values, path_general, options)
+    # plot results of this invocation from the results store (serial and ASHA runs)
+    if options['do_test']:
+        store = ResultsStore(path_general + 'data/results/')
+        where = {'run_id': options['run_id'], 'h_dim': list(h_values), 'z_dim': list(z_values), 'n_layers': list(n_values),
+                 'seq_len_train': options['dataset_options'].seq_len_train or 0,
+                 'batch_size': options['train_options'].batch_size}
+        grid_vaf, (grid_h, grid_z) = store.grid('vaf', ('h_dim', 'z_dim'), where)
+        grid_rmse, _ = store.grid('rmse', ('h_dim', 'z_dim'), where)
+        grid_likelihood, _ = store.grid('marginal_likeli', ('h_dim', 'z_dim'), where)
+        dv.plot_perf_gridsearch(grid_vaf, grid_rmse, grid_likelihood, grid_z, grid_h, path_general, options)
 
     # time output
     time_el = time.time() - start_time
@@ -195,12 +229,17 @@ if __name__ == "__main__":
         'optim': 'Adam',
         'showfig': True,
         'savefig': True,
+        'scheduler': None,  # options: None (full grid), 'asha' (successive halving)
+        'asha_options': {'n_workers': 4,  # parallel worker processes
+                         'min_epochs': 10,  # epochs on the lowest rung
+                         'eta': 3},  # keep the top 1/eta on each rung
     }
 
-    # select parameters for narendra-li benchmark
+    # select parameters for narendra-li benchmark (seeded, all grid points share the data of the dataset cache)
     kwargs = {"k_max_train": 50000,
               "k_max_val": 5000,
-              "k_max_test": 5000}
+              "k_max_test": 5000,
+              "seed": options['seed']}
 
     # values for grid search
     gridvalues = {
@@ -0,0 +1,234 @@
+# import generic libraries
+import torch
+import numpy as np
+import heapq
+import threading
+import json
+import time
+import os
+import sys
+
+os.chdir('../')
+sys.path.append(os.getcwd())
+# import user-written files
+from data.sample_ring import SampleRing
+from data.compressed_timeseries import read_csv_columns
+from models.base import Normalizer1D
+from models.model_state import ModelState
+from models.online_learning import OnlineLearner
+# import options files
+import options.model_options as model_params
+import options.dataset_options as dynsys_params
+import options.train_options as train_params
+
+"""load generator for the inference latency. Recorded test sets are replayed as many concurrent synthetic plants with
+a configurable sample rate and jitter, every plant writes into its own sample ring. The predictor wakes up every
+control period, takes the latest window of all plants as one batch and runs DynamicModel.generate. The step latency
+is measured from the (scheduled) start of the control period, a step which is not finished within the period is a
+missed deadline. With loadopts['online_learning'] the model is fine-tuned in the background on the samples of the first
+plant (models/online_learning.py) and every step uses the model serving at that time, which shows the effect of the
+training thread on the latency."""
+
+
+# %%####################################################################################################################
+# recorded signals
+########################################################################################################################
+def load_signal(source):
+    # returns u, y as ndarray of shape (total_len, 1)
+    if source == 'narendra_li':
+        data = np.load('data/Narendra_Li/narendra_li_testdata.npz')
+        return data['u_test'], data['y_test']
+    elif source == 'toy_lgssm':
+        return np.load('data/Toy_LGSSM/u_test.npy'), np.load('data/Toy_LGSSM/y_test.npy')
+    elif source == 'wiener_hammerstein':
+        # multisine test set, see data/wiener_hammerstein.py
+        data = read_csv_columns('data/WienerHammersteinFiles/WH_TestDataset.csv')
+        return data[:, 2:3], data[:, 4:5]
+    else:
+        raise Exception("Replay source not implemented: {}".format(source))
+
+
+def checkpoint_normalizers(checkpoint):
+    # normalizers of a model trained with normalize=True (None otherwise), the values are restored by load_model
+    state = torch.load(checkpoint, map_location=lambda storage, loc: storage)['model']
+    normalizers = []
+    for name in ('normalizer_input', 'normalizer_output'):
+        if name + '.scale' in state:
+            shape = tuple(state[name + '.scale'].shape)
+            normalizers.append(Normalizer1D(np.ones(shape), np.zeros(shape)))
+        else:
+            normalizers.append(None)
+    return normalizers
+
+
+# %%####################################################################################################################
+# plants: one thread emits the samples of all plants in time order
+########################################################################################################################
+def run_plants(rings, signals, rate, jitter, duration, stop, learner=None):
+    start = time.perf_counter()
+    # (next emission time, plant index, sample index), plants start with a random phase
+    queue = [(start + np.random.rand() / rate, p, 0) for p in range(len(rings))]
+    heapq.heapify(queue)
+    while queue and not stop.is_set():
+        t_next, p, k = heapq.heappop(queue)
+        if t_next - start > duration:
+            break
+        delay = t_next - time.perf_counter()
+        if delay > 0:
+            time.sleep(delay)
+        u, y = signals[p]
+        rings[p].push(u[k % u.shape[0]], y[k % y.shape[0]])
+        if learner is not None and p == 0:
+            learner.push(u[k % u.shape[0]], y[k % y.shape[0]])
+        # sampling interval with relative jitter
+        interval = (1 + jitter * (2 * np.random.rand() - 1)) / rate
+        heapq.heappush(queue, (t_next + interval, p, k + 1))
+
+
+# %%####################################################################################################################
+# Main function
+########################################################################################################################
+def run_main_loadgen(options, loadopts, path_general, file_name_general):
+    print('Run file: main_loadgen.py')
+    torch.set_num_threads(loadopts['threads'])
+
+    # get the options
+    options['device'] = torch.device('cpu')
+    options['dataset_options'] = dynsys_params.get_dataset_options(options['dataset'])
+    options['model_options'] = model_params.get_model_options(options['model'], options['dataset'],
+                                                              options['dataset_options'])
+    options['train_options'] = train_params.get_train_options(options['dataset'])
+
+    # predictor
+    normalizer_input = normalizer_output = None
+    if loadopts['checkpoint'] is not None:
+        normalizer_input, normalizer_output = checkpoint_normalizers(loadopts['checkpoint'])
+    modelstate = ModelState(seed=options['seed'], nu=options['dataset_options'].u_dim,
+                            ny=options['dataset_options'].y_dim, model=options['model'], options=options,
+                            normalizer_input=normalizer_input, normalizer_output=normalizer_output)
+    if loadopts['checkpoint'] is not None:
+        modelstate.load_model(loadopts['checkpoint'])
+    modelstate.model.eval()
+
+    # plants replaying the recorded signals with different offsets
+    n_plants = loadopts['n_plants']
+    seq_len = loadopts['seq_len']
+    u, y = load_signal(loadopts['source'])
+    signals = []
+    for p in range(n_plants):
+        shift = np.random.randint(u.shape[0])
+        signals.append((np.roll(u, shift, axis=0), np.roll(y, shift, axis=0)))
+    rings = [SampleRing(4 * seq_len, u.shape[1], y.shape[1], max_span=seq_len) for _ in range(n_plants)]
+
+    # online fine-tuning in the background
+    learner = None
+    if loadopts['online_learning']:
+        learner = OnlineLearner(modelstate, options, seq_len=seq_len)
+        learner.start()
+
+    stop = threading.Event()
+    plants = threading.Thread(target=run_plants, args=(rings, signals, loadopts['rate'], loadopts['jitter'],
+                                                       loadopts['duration'], stop, learner))
+    plants.start()
+
+    # predictor loop: one batched step per control period
+    period = loadopts['predict_every'] / loadopts['rate']
+    latencies = []
+    missed = 0
+    n_predictions = 0
+    start = time.perf_counter()
+    deadline = start + period
+    with torch.no_grad():
+        while plants.is_alive():
+            delay = deadline - period - time.perf_counter()
+            if delay > 0:
+                time.sleep(delay)
+            scheduled = deadline - period
+
+            # latest window of every plant which has enough samples
+            u_batch = []
+            for ring in rings:
+                n = len(ring)
+                if n >= seq_len:
+                    u_window, _ = ring.window(seq_len, offset=n - seq_len)
+                    u_batch.append(torch.from_numpy(u_window.copy()))
+                    ring.advance(n - seq_len)
+            if u_batch:
+                model = modelstate.model if learner is None else learner.serving
+                model.generate(torch.stack(u_batch))
+                n_predictions += len(u_batch)
+
+            # latency relative to the scheduled start of the period
+            now = time.perf_counter()
+            latencies.append(now - scheduled)
+            if now > deadline:
+                missed += 1
+                # skip the periods which are already over
+                deadline += period * np.ceil((now - deadline) / period)
+            deadline += period
+    # time actually spent in the predictor loop (the throughput under overload or an early / late stop)
+    elapsed = time.perf_counter() - start
+    stop.set()
+    plants.join()
+    if learner is not None:
+        learner.stop()
+
+    # output
+    latencies = np.asarray(latencies)
+    result = {'n_plants': n_plants,
+              'rate': loadopts['rate'],
+              'jitter': loadopts['jitter'],
+              'period_ms': 1e3 * period,
+              'steps': int(latencies.size),
+              'p50_ms': 1e3 * float(np.percentile(latencies, 50)),
+              'p99_ms': 1e3 * float(np.percentile(latencies, 99)),
+              'p999_ms': 1e3 * float(np.percentile(latencies, 99.9)),
+              'max_ms': 1e3 * float(latencies.max()),
+              'missed_deadlines': missed,
+              'elapsed_s': elapsed,
+              'predictions_per_sec': n_predictions / elapsed,
+              'samples_dropped': sum(ring.dropped for ring in rings),
+              'online_learning': learner is not None,
+              'online_updates': learner.n_updates if learner is not None else 0}
+    print('Steps: {}, latency p50={:.3f} ms, p99={:.3f} ms, p999={:.3f} ms, missed deadlines: {} ({:.2f}%)'.format(
+        result['steps'], result['p50_ms'], result['p99_ms'], result['p999_ms'], missed,
+        100. * missed / max(result['steps'], 1)))
+    print('Throughput: {:.0f} plant predictions/s'.format(result['predictions_per_sec']))
+
+    # save data
+    if not os.path.exists(path_general):
+        os.makedirs(path_general)
+    with open(path_general + file_name_general + '.json', 'w') as f:
+        json.dump(result, f, indent=1)
+
+    return result
+
+
+# %%
+if __name__ == "__main__":
+    # set (high level) options dictionary
+    options = {
+        'dataset': 'narendra_li',  # model sizes of this dataset
+        'model': 'VRNN-Gauss',
+        'seed': 1234,
+        'optim': 'Adam',
+    }
+    # set load options dictionary
+    loadopts = {
+        'source': 'narendra_li',  # options: 'narendra_li', 'toy_lgssm', 'wiener_hammerstein'
+        'checkpoint': None,  # path to a trained model, otherwise random weights
+        'n_plants': 64,
+        'rate': 100,  # samples per second of each plant
+        'jitter': 0.1,  # relative jitter of the sampling interval
+        'predict_every': 10,  # samples per control period
+        'seq_len': 50,  # window length of each prediction
+        'duration': 30,  # [s]
+        'threads': 1,
+        'online_learning': False,  # fine-tune the model in a background thread during the run
+    }
+
+    # get saving path
+    path_general = os.getcwd() + '/log/loadgen/'
+    file_name_general = 'loadgen_' + time.strftime("%Y%m%d_%H%M%S")
+
+    run_main_loadgen(options, loadopts, path_general, file_name_general)
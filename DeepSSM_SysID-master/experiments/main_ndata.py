@@ -17,6 +17,7 @@ import training
 import testing
 from utils.utils import compute_normalizer
 from utils.logger import set_redirects
+from utils.results_store import ResultsStore, run_row
 
 # import options files
 import options.model_options as model_params
@@ -87,7 +88,8 @@ def run_main_ndata(options, vary_data, path_general, file_name_general, params):
         # select parameters
         kwargs = {"k_max_train": k_max_train_values[i],
                   "k_max_val": k_max_val_values[i],
-                  "k_max_test": k_max_test_values[i]}
+                  "k_max_test": k_max_test_values[i],
+                  "seed": options['seed']}
 
         # Specifying datasets
         loaders = loader.load_dataset(dataset=options["dataset"],
@@ -124,12 +126,18 @@ def run_main_ndata(options, vary_data, path_general, file_name_general, params):
                                     path_general=path_general,
                                     file_name_general=file_name, )
 
+        # loss curves for the results store, run_test removes them from df
+        loss_curves = {name: df.get(name, []) for name in ('all_losses', 'all_vlosses')}
+
         if options['do_test']:
             # test the model
             df = testing.run_test(options, loaders, df, path_general, file_name)
 
         # store values
         all_df[i] = df
+        if options['do_test']:
+            ResultsStore(path_general + 'data/results/').append(run_row(options, df, k_max_train=k_max_train_values[i],
+                                                                        **loss_curves))
 
         # save performance values
         all_vaf[i] = df['vaf']
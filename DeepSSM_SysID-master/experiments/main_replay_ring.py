@@ -0,0 +1,98 @@
+# import generic libraries
+import numpy as np
+import threading
+import time
+import os
+import sys
+
+os.chdir('../')
+sys.path.append(os.getcwd())
+# import user-written files
+from data.sample_ring import SampleRing
+
+
+# %%####################################################################################################################
+# acquisition thread: replays a recorded test set into the ring
+########################################################################################################################
+def replay_producer(ring, u, y, rate, chunk, stop):
+    period = chunk / rate
+    next_time = time.perf_counter()
+    for k in range(0, u.shape[0], chunk):
+        if stop.is_set():
+            break
+        ring.push(u[k:k + chunk], y[k:k + chunk])
+        # keep the sample rate of the plant
+        next_time += period
+        delay = next_time - time.perf_counter()
+        if delay > 0:
+            time.sleep(delay)
+
+
+# %%####################################################################################################################
+# Main function
+########################################################################################################################
+def run_main_replay_ring(replayopts):
+    print('Run file: main_replay_ring.py')
+
+    # recorded test data of shape (total_len, n_channels)
+    test_data = np.load(replayopts['file_path'])
+    u = test_data['u_test']
+    y = test_data['y_test']
+    print('Replaying {} samples from {} at {} samples/s'.format(u.shape[0], replayopts['file_path'],
+                                                               replayopts['rate']))
+
+    ring = SampleRing(replayopts['capacity'], u.shape[1], y.shape[1], max_span=replayopts['max_span'],
+                      block=replayopts['block'])
+    stop = threading.Event()
+    producer = threading.Thread(target=replay_producer, args=(ring, u, y, replayopts['rate'], replayopts['chunk'],
+                                                              stop))
+    producer.start()
+
+    # inference thread: drain batches of windows
+    seq_len = replayopts['seq_len']
+    batch_size = replayopts['batch_size']
+    n_batches = 0
+    drain_times = []
+    start_time = time.perf_counter()
+    while producer.is_alive() or len(ring) >= seq_len * batch_size:
+        start = time.perf_counter()
+        batch = ring.windows(seq_len, batch_size)
+        if batch is None:
+            time.sleep(replayopts['poll'])
+            continue
+        u_batch, y_batch = batch
+        # the model would consume (u_batch, y_batch) here before the samples are released
+        ring.advance(seq_len * batch_size)
+        drain_times.append(time.perf_counter() - start)
+        n_batches += 1
+    producer.join()
+    time_el = time.perf_counter() - start_time
+
+    # output
+    stats = ring.stats()
+    print('Batches: {}, pushed: {}, dropped: {}, producer blocked: {}, left in ring: {}'.format(
+        n_batches, stats['pushed'], stats['dropped'], stats['blocked'], stats['fill']))
+    if drain_times:
+        print('Drain time per batch: mean {:.2f} us, max {:.2f} us'.format(1e6 * np.mean(drain_times),
+                                                                           1e6 * np.max(drain_times)))
+    print('Effective rate: {:.0f} samples/s'.format(stats['pushed'] / time_el))
+
+    return stats
+
+
+# %%
+if __name__ == "__main__":
+    # set replay options dictionary
+    replayopts = {
+        'file_path': 'data/Narendra_Li/narendra_li_testdata.npz',  # or 'data/Toy_LGSSM/toy_lgssm_testdata.npz'
+        'rate': 100000,  # samples per second
+        'chunk': 100,  # samples per push of the acquisition thread
+        'capacity': 2 ** 16,
+        'max_span': 4096,
+        'block': False,  # backpressure: block the producer instead of dropping samples
+        'seq_len': 256,
+        'batch_size': 8,
+        'poll': 1e-4,  # sleep of the inference thread when no batch is available [s]
+    }
+
+    run_main_replay_ring(replayopts)
@@ -5,6 +5,7 @@ import os
 import torch
 import time
 import sys
+import copy
 import matplotlib.pyplot as plt
 
 os.chdir('../')
@@ -16,6 +17,9 @@ import testing
 from utils.utils import compute_normalizer
 from utils.logger import set_redirects
 from utils.utils import save_options
+from utils.memory_tracker import memtracker
+from utils.data_parallel import run_train_data_parallel
+from utils.hogwild import run_train_hogwild, compare_convergence
 # import options files
 import options.model_options as model_params
 import options.dataset_options as dynsys_params
@@ -60,17 +64,22 @@ def run_main_single(options, path_general, file_name_general):
     # set logger
     set_redirects(path, file_name_general)
 
+    # memory usage per phase
+    memtracker.enable(options.get('memtrack', False))
+
     # Specifying datasets
-    loaders = loader.load_dataset(dataset=options["dataset"],
-                                  dataset_options=options["dataset_options"],
-                                  train_batch_size=options["train_options"].batch_size,
-                                  test_batch_size=options["test_options"].batch_size, )
+    with memtracker.scope('dataset'):
+        loaders = loader.load_dataset(dataset=options["dataset"],
+                                      dataset_options=options["dataset_options"],
+                                      train_batch_size=options["train_options"].batch_size,
+                                      test_batch_size=options["test_options"].batch_size, )
 
     # Compute normalizers
-    if options["normalize"]:
-        normalizer_input, normalizer_output = compute_normalizer(loaders['train'])
-    else:
-        normalizer_input = normalizer_output = None
+    with memtracker.scope('normalizer'):
+        if options["normalize"]:
+            normalizer_input, normalizer_output = compute_normalizer(loaders['train'])
+        else:
+            normalizer_input = normalizer_output = None
 
     # Define model
     modelstate = ModelState(seed=options["seed"],
@@ -86,7 +95,39 @@ def run_main_single(options, path_general, file_name_general):
 
     # allocation
     df = {}
-    if options['do_train']:
+    if options['do_train'] and options.get('n_processes', 1) > 1:
+        # train the model data parallel on local processes
+        df = run_train_data_parallel(modelstate=modelstate,
+                                     loader_train=loaders['train'],
+                                     loader_valid=loaders['valid'],
+                                     options=options,
+                                     dataframe=df,
+                                     path_general=path_general,
+                                     file_name_general=file_name_general,
+                                     n_processes=options['n_processes'])
+    elif options['do_train'] and options.get('hogwild_threads', 0) > 0:
+        # synchronous baseline from the same initialization for the convergence comparison
+        if options.get('hogwild_compare', False):
+            modelstate_sync = copy.deepcopy(modelstate)
+            df_sync = training.run_train(modelstate=modelstate_sync,
+                                         loader_train=loaders['train'],
+                                         loader_valid=loaders['valid'],
+                                         options=options,
+                                         dataframe={},
+                                         path_general=path_general,
+                                         file_name_general=file_name_general + '_sync')
+        # train the model lock-free on multiple threads
+        df = run_train_hogwild(modelstate=modelstate,
+                               loader_train=loaders['train'],
+                               loader_valid=loaders['valid'],
+                               options=options,
+                               dataframe=df,
+                               path_general=path_general,
+                               file_name_general=file_name_general,
+                               n_threads=options['hogwild_threads'])
+        if options.get('hogwild_compare', False):
+            compare_convergence(df_sync, df, options['train_options'].test_every)
+    elif options['do_train']:
         # train the model
         df = training.run_train(modelstate=modelstate,
                                 loader_train=loaders['train'],
@@ -136,6 +177,12 @@ if __name__ == "__main__":
         'optim': 'Adam',
         'showfig': True,
         'savefig': False,
+        'profile': False,  # time the model submodules and save a chrome trace
+        'memtrack': False,  # report the memory usage per training phase
+        'n_processes': 1,  # number of local processes for data parallel training
+        'barrier_timeout': 600.,  # [s] data parallel training stops if a process does not reach the reduction
+        'hogwild_threads': 0,  # number of threads for lock-free hogwild training (0: off)
+        'hogwild_compare': False,  # run synchronous training as convergence baseline for hogwild
     }
 
     # get saving path
@@ -138,7 +138,8 @@ if __name__ == "__main__":
             # select parameters
             kwargs = {"k_max_train": k_max_train_values[i],
                       "k_max_val": k_max_val_values[i],
-                      "k_max_test": k_max_test_values[i]}
+                      "k_max_test": k_max_test_values[i],
+                      "seed": options['seed'] + mcIter}
 
             # Specifying datasets
             loaders = loader.load_dataset(dataset=options["dataset"],
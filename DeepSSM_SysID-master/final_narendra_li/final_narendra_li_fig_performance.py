@@ -7,6 +7,86 @@ import pandas as pd
 import sys
 os.chdir('../')
 sys.path.append(os.getcwd())
+# only to compute the performance if not available
+import data.loader as loader
+from models.model_state import ModelState
+from utils.batch_evaluation import evaluate_checkpoints
+import options.model_options as model_params
+import options.dataset_options as dynsys_params
+import options.train_options as train_params
+
+
+# %% get performance results if not available
+
+def get_perf_results(path_general, model_name):
+    options = {
+        'dataset': 'narendra_li',
+        'model': model_name,
+        'normalize': False,
+        'seed': 1234,
+        'optim': 'Adam',
+        'MCsamples': 30,
+        'optValue': {
+            'h_opt': 60,
+            'z_opt': 10,
+            'n_opt': 1, },
+    }
+
+    # get the options
+    options['device'] = torch.device('cpu')
+    options['dataset_options'] = dynsys_params.get_dataset_options(options['dataset'])
+    options['model_options'] = model_params.get_model_options(options['model'], options['dataset'],
+                                                              options['dataset_options'])
+    options['train_options'] = train_params.get_train_options(options['dataset'])
+    options['test_options'] = train_params.get_test_options()
+    options['model_options'].h_dim = options['optValue']['h_opt']
+    options['model_options'].z_dim = options['optValue']['z_opt']
+    options['model_options'].n_layers = options['optValue']['n_opt']
+
+    # Specifying datasets (only the test set matters, it is the same for all runs)
+    kwargs = {"k_max_train": ndata[0],
+              "k_max_val": 5000,
+              "k_max_test": 5000}
+    loaders = loader.load_dataset(dataset=options["dataset"],
+                                  dataset_options=options["dataset_options"],
+                                  train_batch_size=options["train_options"].batch_size,
+                                  test_batch_size=options["test_options"].batch_size,
+                                  **kwargs)
+    u_test, y_test = next(iter(loaders['test']))
+    # original test set is unnoisy -> get noisy test set
+    y_test_noisy = y_test.numpy() + np.sqrt(0.1) * np.random.randn(*y_test.shape)
+
+    # Define model
+    modelstate = ModelState(seed=options["seed"],
+                            nu=loaders["train"].nu, ny=loaders["train"].ny,
+                            model=options["model"],
+                            options=options)
+
+    # allocation
+    vaf_all = torch.zeros([options['MCsamples'], len(ndata)])
+    rmse_all = torch.zeros([options['MCsamples'], len(ndata)])
+    likelihood_all = torch.zeros([options['MCsamples'], len(ndata)])
+
+    for i, k_max_train in enumerate(ndata):
+        # checkpoints of all MC iterations, evaluated as one stacked model
+        files = [path_general + 'model/' + options['dataset'] +
+                 '_kmaxtrain_{}_MC{}_bestModel.ckpt'.format(k_max_train, mcIter)
+                 for mcIter in range(options['MCsamples'])]
+        for mcIter, (_, df) in enumerate(evaluate_checkpoints(modelstate, files, u_test, y_test_noisy)):
+            vaf_all[mcIter, i] = df['vaf']
+            rmse_all[mcIter, i] = df['rmse'][0]
+            likelihood_all[mcIter, i] = df['marginal_likeli'].item()
+        print('{}: k_max_train={} evaluated'.format(model_name, k_max_train))
+
+    # save data
+    datasaver = {'vaf_all': vaf_all,
+                 'rmse_all': rmse_all,
+                 'likelihood_all': likelihood_all}
+    path = path_general + 'data/'
+    if not os.path.exists(path):
+        os.makedirs(path)
+    torch.save(datasaver, path + options['dataset'] + '.pt')
+
 
 # %%
 # set (high level) options dictionary
@@ -27,6 +107,9 @@ for i, model_sel in enumerate(model):
     # get data
     file_name = dataset + '.pt'
     path = path_general + 'data/'
+    if not os.path.exists(path + file_name):
+        # evaluate all available checkpoints and save the data in '/data'
+        get_perf_results(path_general, model_sel)
     data = torch.load(path + file_name)
 
     # load the data: RMSE
@@ -15,6 +15,7 @@ import models.model_state
 import training
 import utils.dataevaluater as de
 import utils.datavisualizer as dv
+import utils.renderer as renderer
 from utils.utils import get_n_params
 from utils.kalman_filter import run_kalman_filter
 from utils.utils import compute_normalizer
@@ -116,7 +117,8 @@ if __name__ == "__main__":
         # select parameters for toy lgssm
         kwargs = {"k_max_train": 2000,
                   "k_max_val": 2000,
-                  "k_max_test": 5000}
+                  "k_max_test": 5000,
+                  "seed": options['seed'] + mcIter}
 
         # Specifying datasets
         loaders = loader.load_dataset(dataset=options["dataset"],
@@ -179,7 +181,8 @@ if __name__ == "__main__":
             modelstate.model.to(options['device'])
 
             # plot and save the loss curve
-            dv.plot_losscurve(df, options, path_general, file_name_general_it, removedata=False)
+            renderer.render(options, dv.plot_losscurve, df, options, path_general, file_name_general_it,
+                            removedata=False)
 
             # sample from the model
             for i, (u_test, y_test) in enumerate(loaders['test']):
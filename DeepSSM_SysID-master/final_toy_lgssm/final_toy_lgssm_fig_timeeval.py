@@ -131,12 +131,18 @@ if __name__ == "__main__":
         y_test_noisy = y_test + np.sqrt(1) * np.random.randn(yshape[0], yshape[1], yshape[2])
 
         # run identified model in OL
-        mat = scipy.io.loadmat('final_toy_lgssm/toy_identifiedsystem.mat')
+        if os.path.exists('final_toy_lgssm/toy_identifiedsystem.npz'):
+            # identified by final_toy_lgssm_identification.py
+            mat = np.load('final_toy_lgssm/toy_identifiedsystem.npz')
+            y_id = mat['yid']
+        else:
+            # identified by Matlab/final_toy_lgssm_comparison_OL.m
+            mat = scipy.io.loadmat('final_toy_lgssm/toy_identifiedsystem.mat')
+            y_id = mat['yid'].transpose()
         Aid = mat['A']
         Bid = mat['B']
         Cid = mat['C']
         std_id = mat['std']
-        y_id = mat['yid'].transpose()
 
         # %% plot time evaluation with uncertainty
 
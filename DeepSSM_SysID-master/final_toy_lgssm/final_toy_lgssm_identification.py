@@ -0,0 +1,78 @@
+# import generic libraries
+import numpy as np
+import os
+import sys
+
+os.chdir('../')
+sys.path.append(os.getcwd())
+# import user-written files
+import utils.dataevaluater as de
+from data.toy_lgssm import run_toy_lgssm_sim
+from utils.lgssm_em import run_em_restarts, simulate_lgssm, output_std
+
+"""identification of the linear baseline for the toy LGSSM with EM (utils/lgssm_em.py), replaces
+Matlab/final_toy_lgssm_comparison_OL.m. The identified model of the last Monte Carlo run is stored in
+final_toy_lgssm/toy_identifiedsystem.npz and used by final_toy_lgssm_fig_timeeval.py."""
+
+# set options dictionary
+options = {
+    'nx': 2,  # state size of the identified model
+    'k_max_train': 2000,
+    'k_max_test': 5000,
+    'MC_iter': 10,  # Monte Carlo iterations with new training data
+    'n_restarts': 8,  # parallel EM restarts per identification
+    'n_iter': 200,
+    'seed': 1234,
+}
+
+# %%
+if __name__ == "__main__":
+    print('Run file: final_toy_lgssm_identification.py')
+    np.random.seed(options['seed'])
+
+    # true system
+    A = np.array([[0.7, 0.8], [0, 0.1]])
+    B = np.array([[-1], [0.1]])
+    C = np.array([[1], [0]]).transpose()
+
+    # load the test data
+    u_test = np.load('data/Toy_LGSSM/u_test.npy')[:options['k_max_test']].reshape(1, -1)
+    y_test = np.load('data/Toy_LGSSM/y_test.npy')[:options['k_max_test']].reshape(1, -1)
+    y_test = y_test + np.random.randn(*y_test.shape)
+
+    # allocation
+    rmse_OL_id = np.zeros(options['MC_iter'])
+    rmse_OL_true = np.zeros(options['MC_iter'])
+    loglike_OL_id = np.zeros(options['MC_iter'])
+
+    for i in range(options['MC_iter']):
+        print('MC_Iter={}'.format(i))
+
+        # get new data
+        u_train = (np.random.rand(1, options['k_max_train']) - 0.5) * 5
+        y_train = run_toy_lgssm_sim(u_train, A, B, C, 0.5, 0) + np.random.randn(1, options['k_max_train'])
+
+        # identify model: EM with restarts
+        sys_id = run_em_restarts(u_train, y_train, options['nx'], n_restarts=options['n_restarts'],
+                                 n_iter=options['n_iter'], seed=options['seed'] + i * options['n_restarts'])
+        std_id = output_std(sys_id['A'], sys_id['C'], sys_id['Q'], sys_id['R'])
+
+        # test identified model in open loop
+        y_test_OL_id = simulate_lgssm(sys_id['A'], sys_id['B'], sys_id['C'], u_test)
+        rmse_OL_id[i] = de.compute_rmse(y_test[None], y_test_OL_id[None])[0]
+        loglike_OL_id[i] = de.compute_marginalLikelihood(y_test[None], y_test_OL_id[None],
+                                                         std_id[None, :, None] * np.ones_like(y_test_OL_id[None]))
+
+        # test true model in open loop
+        y_test_OL_true = simulate_lgssm(A, B, C, u_test)
+        rmse_OL_true[i] = de.compute_rmse(y_test[None], y_test_OL_true[None])[0]
+
+    print('\nmean RMSE OL identified: {:.4f}'.format(rmse_OL_id.mean()))
+    print('std RMSE OL identified: {:.4f}'.format(rmse_OL_id.std()))
+    print('LL OL identified: {:.4f}'.format(loglike_OL_id.mean()))
+    print('\nmean RMSE OL true: {:.4f}'.format(rmse_OL_true.mean()))
+    print('std RMSE OL true: {:.4f}'.format(rmse_OL_true.std()))
+
+    # save the identified model of the last run
+    np.savez('final_toy_lgssm/toy_identifiedsystem.npz', A=sys_id['A'], B=sys_id['B'], C=sys_id['C'], Q=sys_id['Q'],
+             R=sys_id['R'], std=std_id, yid=y_test_OL_id)
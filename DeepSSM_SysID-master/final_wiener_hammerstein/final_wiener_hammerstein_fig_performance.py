@@ -7,7 +7,7 @@ import sys
 # only to compute the performance if not available
 import data.loader as loader
 from models.model_state import ModelState
-import testing
+from utils.batch_evaluation import evaluate_checkpoints
 from utils.utils import compute_normalizer
 import options.model_options as model_params
 import options.dataset_options as dynsys_params
@@ -61,79 +61,70 @@ def get_perf_results(path_general, model_name):
     rmse_all_sweptsine = torch.zeros([options['MCsamples'], len(h_values), len(z_values), len(n_values)])
     likelihood_all_sweptsine = torch.zeros([options['MCsamples'], len(h_values), len(z_values), len(n_values)])
 
-    for mcIter in range(options['MCsamples']):
-        print('\n#####################')
-        print('MC ITERATION: {}/{}'.format(mcIter + 1, options['MCsamples']))
-        print('#####################\n')
-
-        for i1, h_sel in enumerate(h_values):
-            for i2, z_sel in enumerate(z_values):
-                for i3, n_sel in enumerate(n_values):
-
-                    # output current choice
-                    print('\nCurrent run: h={}, z={}, n={}\n'.format(h_sel, z_sel, n_sel))
-
-                    # get curren file names
-                    file_name = file_name_general + '_h{}_z{}_n{}_MC{}'.format(h_sel, z_sel, n_sel, mcIter)
-
-                    # set new values in options
-                    options['model_options'].h_dim = h_sel
-                    options['model_options'].z_dim = z_sel
-                    options['model_options'].n_layers = n_sel
-
-                    # Specifying datasets (only matters for testing
-                    kwargs = {'test_set': 'multisine', 'MCiter': mcIter, 'train_set': options['train_set']}
-                    loaders_multisine = loader.load_dataset(dataset=options["dataset"],
-                                                            dataset_options=options["dataset_options"],
-                                                            train_batch_size=options["train_options"].batch_size,
-                                                            test_batch_size=options["test_options"].batch_size,
-                                                            **kwargs)
-
-                    kwargs = {'test_set': 'sweptsine', 'MCiter': mcIter}
-                    loaders_sweptsine = loader.load_dataset(dataset=options["dataset"],
-                                                            dataset_options=options["dataset_options"],
-                                                            train_batch_size=options["train_options"].batch_size,
-                                                            test_batch_size=options["test_options"].batch_size,
-                                                            **kwargs)
-
-                    # Compute normalizers
-                    if options["normalize"]:
-                        normalizer_input, normalizer_output = compute_normalizer(loaders_multisine['train'])
-                    else:
-                        normalizer_input = normalizer_output = None
-
-                    # Define model
-                    modelstate = ModelState(seed=options["seed"],
-                                            nu=loaders_multisine["train"].nu, ny=loaders_multisine["train"].ny,
-                                            model=options["model"],
-                                            options=options,
-                                            normalizer_input=normalizer_input,
-                                            normalizer_output=normalizer_output)
-                    modelstate.model.to(options['device'])
-
-                    # allocation
-                    df = {}
-
-                    # test the model
-                    print('\nTest: Multisine')
-                    kwargs = {'file_name_add': 'Multisine_'}
-                    df_multisine = df
-                    df_multisine = testing.run_test(options, loaders_multisine, df_multisine, path_general, file_name,
-                                                    **kwargs)
-                    print('\nTest: Sweptsine')
-                    kwargs = {'file_name_add': 'Sweptsine_'}
-                    df_sweptsine = {}
-                    df_sweptsine = testing.run_test(options, loaders_sweptsine, df_sweptsine, path_general, file_name,
-                                                    **kwargs)
-
-                    # save performance values
-                    vaf_all_multisine[mcIter, i1, i2, i3] = df_multisine['vaf']
-                    rmse_all_multisine[mcIter, i1, i2, i3] = df_multisine['rmse'][0]
-                    likelihood_all_multisine[mcIter, i1, i2, i3] = df_multisine['marginal_likeli'].item()
-
-                    vaf_all_sweptsine[mcIter, i1, i2, i3] = df_sweptsine['vaf']
-                    rmse_all_sweptsine[mcIter, i1, i2, i3] = df_sweptsine['rmse'][0]
-                    likelihood_all_sweptsine[mcIter, i1, i2, i3] = df_sweptsine['marginal_likeli'].item()
+    for i1, h_sel in enumerate(h_values):
+        for i2, z_sel in enumerate(z_values):
+            for i3, n_sel in enumerate(n_values):
+
+                # output current choice
+                print('\nCurrent run: h={}, z={}, n={}\n'.format(h_sel, z_sel, n_sel))
+
+                # set new values in options
+                options['model_options'].h_dim = h_sel
+                options['model_options'].z_dim = z_sel
+                options['model_options'].n_layers = n_sel
+
+                # Specifying datasets (only the test sets matter, they are the same for all MC iterations)
+                kwargs = {'test_set': 'multisine', 'MCiter': 0, 'train_set': options['train_set']}
+                loaders_multisine = loader.load_dataset(dataset=options["dataset"],
+                                                        dataset_options=options["dataset_options"],
+                                                        train_batch_size=options["train_options"].batch_size,
+                                                        test_batch_size=options["test_options"].batch_size,
+                                                        **kwargs)
+
+                kwargs = {'test_set': 'sweptsine', 'MCiter': 0}
+                loaders_sweptsine = loader.load_dataset(dataset=options["dataset"],
+                                                        dataset_options=options["dataset_options"],
+                                                        train_batch_size=options["train_options"].batch_size,
+                                                        test_batch_size=options["test_options"].batch_size,
+                                                        **kwargs)
+
+                # Compute normalizers (here just used for initialization, real values loaded from the checkpoints)
+                if options["normalize"]:
+                    normalizer_input, normalizer_output = compute_normalizer(loaders_multisine['train'])
+                else:
+                    normalizer_input = normalizer_output = None
+
+                # Define model
+                modelstate = ModelState(seed=options["seed"],
+                                        nu=loaders_multisine["train"].nu, ny=loaders_multisine["train"].ny,
+                                        model=options["model"],
+                                        options=options,
+                                        normalizer_input=normalizer_input,
+                                        normalizer_output=normalizer_output)
+                modelstate.model.to(options['device'])
+
+                # checkpoints of all MC iterations, evaluated as one stacked model
+                files = [path_general + 'model/' + file_name_general +
+                         '_h{}_z{}_n{}_MC{}_bestModel.ckpt'.format(h_sel, z_sel, n_sel, mcIter)
+                         for mcIter in range(options['MCsamples'])]
+
+                for test_set, loaders in [('multisine', loaders_multisine), ('sweptsine', loaders_sweptsine)]:
+                    print('\nTest: {}'.format(test_set))
+                    u_test, y_test = next(iter(loaders['test']))
+                    for mcIter, (_, df) in enumerate(evaluate_checkpoints(modelstate, files, u_test,
+                                                                          y_test.numpy())):
+                        print('MC={}: vaf={:.3f}, rmse={:.3f}, marginal likelihood={:.3f}'.format(
+                            mcIter, df['vaf'], df['rmse'][0], df['marginal_likeli']))
+                        # save performance values
+                        if test_set == 'multisine':
+                            vaf_all_multisine[mcIter, i1, i2, i3] = df['vaf']
+                            rmse_all_multisine[mcIter, i1, i2, i3] = df['rmse'][0]
+                            likelihood_all_multisine[mcIter, i1, i2, i3] = df['marginal_likeli'].item()
+                        else:
+                            vaf_all_sweptsine[mcIter, i1, i2, i3] = df['vaf']
+                            rmse_all_sweptsine[mcIter, i1, i2, i3] = df['rmse'][0]
+                            likelihood_all_sweptsine[mcIter, i1, i2, i3] = df['marginal_likeli'].item()
+
     # save data
     datasaver = {'all_vaf_multisine': vaf_all_multisine,
                  'all_rmse_multisine': rmse_all_multisine,
@@ -114,6 +114,7 @@ if __name__ == "__main__":
         for i, (u_test, y_test) in enumerate(loaders['test']):
             # getting output distribution parameter only implemented for selected models
             u_test = u_test.to(options['device'])
+            u_test_full, y_test_full = u_test, y_test
             u_test = u_test[:, :, :maxN]
             y_test = y_test[:, :, :maxN]
             y_sample, y_sample_mu, y_sample_sigma = modelstate.model.generate(u_test)
@@ -178,6 +179,17 @@ if __name__ == "__main__":
         # compute RMSE
         rmse = de.compute_rmse(y_test, y_sample_mu, doprint=True)
 
+        # %% frequency domain evaluation of the multisine response (complete test sequence, steady state)
+        if kwargs['test_set'] == 'multisine':
+            period_len = de.find_period(u_test_full.numpy())
+            if period_len is not None:
+                with torch.no_grad():
+                    _, y_full_mu, _ = modelstate.model.generate(u_test_full)
+                print('Frequency domain ({} samples per period):'.format(period_len))
+                freq_eval = de.compute_frequency_response(y_test_full.numpy(), y_full_mu.numpy(), period_len,
+                                                          u=u_test_full.numpy(), fs=fs, n_transient=period_len,
+                                                          doprint=True)
+
         # %% store simulation data in csv file
         muTest = y_test.squeeze()
         muModel = y_sample_mu.squeeze()
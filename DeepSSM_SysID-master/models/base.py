@@ -48,3 +48,19 @@ class DynamicModule(nn.Module):
         if self.has_internal_state:
             raise NotImplementedError
 
+
+# masks of multi-trajectory batches (data/multi_trajectory.py): 0 padding, 1 data, 2 first sample of a trajectory
+def reset_state(h, mask, t):
+    # zero state in the slots where a new trajectory starts at time t
+    if mask is None:
+        return h
+    keep = (mask[:, t] != 2).to(h.dtype)
+    return h * keep.view(1, -1, 1)
+
+
+def select_valid(mask, t, *x):
+    # rows of the slots which hold data at time t (padding does not count in the loss)
+    if mask is None:
+        return x
+    valid = mask[:, t] > 0
+    return tuple(x_i[valid] for x_i in x)
@@ -39,21 +39,22 @@ class DynamicModel(nn.Module):
     def num_model_inputs(self):
         return self.num_inputs + self.num_outputs if self.ar else self.num_inputs
 
-    def forward(self, u, y=None):
+    def forward(self, u, y=None, mask=None):
+        # mask: optional (batch, seq_len) mask of multi-trajectory batches (data/multi_trajectory.py)
         if self.normalizer_input is not None:
             u = self.normalizer_input.normalize(u)
         if y is not None and self.normalizer_output is not None:
             y = self.normalizer_output.normalize(y)
 
-        loss = self.m(u, y)
+        loss = self.m(u, y, mask)
 
         return loss
 
-    def generate(self, u, y=None):
+    def generate(self, u, y=None, mask=None):
         if self.normalizer_input is not None:
             u = self.normalizer_input.normalize(u)
 
-        y_sample, y_sample_mu, y_sample_sigma = self.m.generate(u)
+        y_sample, y_sample_mu, y_sample_sigma = self.m.generate(u, mask=mask)
 
         if self.normalizer_output is not None:
             y_sample = self.normalizer_output.unnormalize(y_sample)
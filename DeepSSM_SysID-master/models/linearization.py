@@ -0,0 +1,119 @@
+import torch
+import torch.autograd.forward_ad as fwAD
+
+"""local linear models of a trained model along a trajectory,
+    x_t+1 = A_t x_t + B_t u_t,    y_t = C_t x_t + D_t u_t,
+with the state x_t = h_t (all GRU layers stacked, layer by layer). The nominal trajectory is the noise-free one, i.e.
+z_t and y_t are the means of the prior and the decoder (generate_step(..., sample=False)).
+The Jacobians are computed in forward mode. Every linearization point is copied once per state and input direction
+into the batch and each copy carries the unit tangent of its direction, hence a single forward pass of the GRU and MLP
+layers propagates all tangents of all points at once. The matrices are in the units of the data (not normalized), the
+same as the matrices A, B, C of the linear baseline in utils/kalman_filter.py."""
+
+
+def nominal_trajectory(model, u):
+    # u: tensor, shape (batch, nu, seq_len) unnormalized; returns the states x_t, shape (batch, seq_len, n) and y_t
+    m = model.m
+    if model.normalizer_input is not None:
+        u = model.normalizer_input.normalize(u)
+    batch_size, _, seq_len = u.shape
+    h = torch.zeros(m.n_layers, batch_size, m.h_dim, device=m.device)
+    x = torch.zeros(batch_size, seq_len, m.n_layers * m.h_dim, device=m.device)
+    y = torch.zeros(batch_size, m.y_dim, seq_len, device=m.device)
+    with torch.no_grad():
+        for t in range(seq_len):
+            x[:, t, :] = h.permute(1, 0, 2).reshape(batch_size, -1)
+            _, y[:, :, t], _, h = m.generate_step(u[:, :, t], h, sample=False)
+    if model.normalizer_output is not None:
+        y = model.normalizer_output.unnormalize_mean(y)
+    return x, y
+
+
+def _jacobians(model, x, u):
+    # x: (n_points, n), u: (n_points, nu) normalized; returns dh_t+1/dx, dh_t+1/du, dy/dx, dy/du of all points
+    m = model.m
+    n_points, n = x.shape
+    nu = u.shape[1]
+    n_dir = n + nu
+    # one copy per direction, copy k of a point carries the tangent e_k of (x, u)
+    x_rep = x.repeat_interleave(n_dir, dim=0)
+    u_rep = u.repeat_interleave(n_dir, dim=0)
+    eye = torch.eye(n_dir, device=x.device).repeat(n_points, 1)
+    with torch.no_grad(), fwAD.dual_level():
+        x_dual = fwAD.make_dual(x_rep, eye[:, :n])
+        u_dual = fwAD.make_dual(u_rep, eye[:, n:])
+        h = x_dual.view(n_points * n_dir, m.n_layers, m.h_dim).permute(1, 0, 2).contiguous()
+        _, y_mu, _, h_next = m.generate_step(u_dual, h, sample=False)
+        dh = fwAD.unpack_dual(h_next).tangent
+        dy = fwAD.unpack_dual(y_mu).tangent
+    # columns of the Jacobians: (n_points, n_out, n_dir)
+    dh = dh.permute(1, 0, 2).reshape(n_points, n_dir, n).transpose(1, 2)
+    dy = dy.reshape(n_points, n_dir, -1).transpose(1, 2)
+    return dh[:, :, :n], dh[:, :, n:], dy[:, :, :n], dy[:, :, n:]
+
+
+def linearize_stream(model, u, chunk_len=100):
+    # u: tensor, shape (batch, nu, seq_len) unnormalized
+    # yields (t0, A, B, C, D) for consecutive chunks of the trajectory, A: (batch, chunk_len, n, n), B: (..., n, nu),
+    # C: (..., ny, n), D: (..., ny, nu)
+    model.eval()
+    x, _ = nominal_trajectory(model, u)
+    if model.normalizer_input is not None:
+        u = model.normalizer_input.normalize(u)
+    batch_size, _, seq_len = u.shape
+    n = x.shape[-1]
+    for t0 in range(0, seq_len, chunk_len):
+        t1 = min(t0 + chunk_len, seq_len)
+        x_c = x[:, t0:t1, :].reshape(-1, n)
+        u_c = u[:, :, t0:t1].permute(0, 2, 1).reshape(-1, u.shape[1])
+        A, B, C, D = _jacobians(model, x_c, u_c)
+        # back to the units of the data
+        if model.normalizer_input is not None:
+            B = B / model.normalizer_input.scale
+            D = D / model.normalizer_input.scale
+        if model.normalizer_output is not None:
+            C = model.normalizer_output.scale[:, None] * C
+            D = model.normalizer_output.scale[:, None] * D
+        shape = (batch_size, t1 - t0)
+        yield t0, A.view(*shape, *A.shape[1:]), B.view(*shape, *B.shape[1:]), C.view(*shape, *C.shape[1:]), \
+            D.view(*shape, *D.shape[1:])
+
+
+def linearize(model, u, chunk_len=100):
+    # complete trajectory: A (batch, seq_len, n, n), B (batch, seq_len, n, nu), C (batch, seq_len, ny, n), D
+    chunks = list(linearize_stream(model, u, chunk_len))
+    return tuple(torch.cat([chunk[k] for chunk in chunks], dim=1) for k in range(1, 5))
+
+
+# %% comparison with the (LTI) Kalman baseline, independent of the choice of the state coordinates
+def spectral_radius(A):
+    # A: (..., n, n)
+    return torch.linalg.eigvals(torch.as_tensor(A, dtype=torch.float64)).abs().max(-1).values
+
+
+def markov_parameters(A, B, C, D=None, n_markov=20):
+    # impulse response D, CB, CAB, ... of the (frozen) linear model, A: (..., n, n); returns (..., n_markov, ny, nu)
+    A, B, C = [torch.as_tensor(M, dtype=torch.float64) for M in (A, B, C)]
+    markov = [torch.zeros(*C.shape[:-1], B.shape[-1], dtype=torch.float64) if D is None else
+              torch.as_tensor(D, dtype=torch.float64)]
+    AkB = B
+    for k in range(1, n_markov):
+        markov.append(C @ AkB)
+        AkB = A @ AkB
+    return torch.stack(markov, dim=-3)
+
+
+def compare_with_baseline(A_t, B_t, C_t, A, B, C, n_markov=20):
+    # A_t, B_t, C_t: local models along the trajectory, A, B, C: ndarrays of the linear baseline (run_kalman_filter)
+    rho_t = spectral_radius(A_t)
+    rho = float(spectral_radius(A))
+    markov_t = markov_parameters(A_t, B_t, C_t, n_markov=n_markov)
+    markov = markov_parameters(A, B, C, n_markov=n_markov)
+    err = (markov_t - markov).norm(dim=(-2, -1)).sum(-1) / markov.norm(dim=(-2, -1)).sum(-1)
+    print('Spectral radius: baseline {:.4f}, local models mean {:.4f} (min {:.4f}, max {:.4f})'.format(
+        rho, float(rho_t.mean()), float(rho_t.min()), float(rho_t.max())))
+    print('Relative error of the Markov parameters: mean {:.4f}, max {:.4f}'.format(float(err.mean()),
+                                                                                   float(err.max())))
+    return {'spectral_radius_baseline': rho,
+            'spectral_radius': rho_t.cpu().numpy(),
+            'markov_error': err.cpu().numpy()}
@@ -0,0 +1,130 @@
+import torch
+
+"""hidden-state snapshots and streaming sessions for the generating models. In generation the only carry of all models
+is the GRU state h of shape (n_layers, batch, h_dim), see generate_step() of the models.
+A HiddenState is an immutable snapshot of h. Nothing writes into its tensor, so forks and selections share the storage
+with the snapshot (torch reference counts the storage) and only the recurrence creates new memory. A ModelSession runs
+a DynamicModel step by step from such a state, hence a common prefix is computed once and every branch continues from
+its snapshot instead of rerunning generate from h=0."""
+
+
+class HiddenState(object):
+    def __init__(self, h, t=0, model=None):
+        # h: tensor, shape (n_layers, batch, h_dim), t: number of steps since the zero state, model: name of the model
+        self.h = h.detach()
+        self.t = t
+        self.model = model
+
+    @property
+    def batch_size(self):
+        return self.h.shape[1]
+
+    @classmethod
+    def zeros(cls, model, batch_size=1):
+        # model: DynamicModel
+        m = model.m
+        return cls(torch.zeros(m.n_layers, batch_size, m.h_dim, device=m.device), model=type(m).__name__)
+
+    def fork(self, n):
+        # every slot is repeated n times (slot k -> slots k * n ... k * n + n - 1)
+        if self.batch_size == 1:
+            # common prefix: broadcast view, no copy
+            h = self.h.expand(self.h.shape[0], n, self.h.shape[2])
+        else:
+            h = self.h.repeat_interleave(n, dim=1)
+        return HiddenState(h, self.t, self.model)
+
+    def select(self, slots):
+        # snapshot of some slots, slots: int, list or slice
+        if isinstance(slots, int):
+            slots = [slots]
+        return HiddenState(self.h[:, slots, :], self.t, self.model)
+
+    @staticmethod
+    def cat(states):
+        # one snapshot with the slots of all given snapshots
+        return HiddenState(torch.cat([state.h for state in states], dim=1), max(state.t for state in states),
+                           states[0].model)
+
+    def restore_into(self, h, slots):
+        # returns a copy of the batch state h where the given slots are replaced by this snapshot
+        if isinstance(slots, int):
+            slots = [slots]
+        slots = torch.as_tensor(slots, device=h.device)
+        if slots.numel() != self.batch_size and self.batch_size != 1:
+            raise Exception("Number of slots does not match the snapshot")
+        return h.index_copy(1, slots, self.h.expand(h.shape[0], slots.numel(), h.shape[2]).to(h.device))
+
+    # %% serialization
+    def state_dict(self):
+        return {'h': self.h.cpu().contiguous(), 't': self.t, 'model': self.model}
+
+    @classmethod
+    def from_state_dict(cls, state_dict, device='cpu'):
+        return cls(state_dict['h'].to(device), state_dict['t'], state_dict['model'])
+
+    def save(self, path):
+        torch.save(self.state_dict(), path)
+
+    @classmethod
+    def load(cls, path, device='cpu'):
+        return cls.from_state_dict(torch.load(path), device)
+
+
+class ModelSession(object):
+    def __init__(self, model, state=None, batch_size=1):
+        # model: DynamicModel, state: HiddenState to start from, otherwise the zero state
+        self.model = model
+        self.model.eval()
+        if state is None:
+            state = HiddenState.zeros(model, batch_size)
+        elif state.model is not None and state.model != type(model.m).__name__:
+            raise Exception("State of {} cannot be restored into {}".format(state.model, type(model.m).__name__))
+        self.h = state.h
+        self.t = state.t
+
+    @property
+    def batch_size(self):
+        return self.h.shape[1]
+
+    def snapshot(self, slots=None):
+        state = HiddenState(self.h, self.t, type(self.model.m).__name__)
+        return state if slots is None else state.select(slots)
+
+    def restore(self, state, slots=None):
+        # whole state or only the given slots of the batch
+        if slots is None:
+            self.h = state.h
+        else:
+            self.h = state.restore_into(self.h, slots)
+        self.t = state.t
+
+    def fork(self, n):
+        # new session continuing every slot of this session in n branches
+        return ModelSession(self.model, self.snapshot().fork(n))
+
+    def run(self, u):
+        # u: tensor, shape (batch, nu, seq_len); continues the session, returns y sample, mean and std like generate
+        m = self.model.m
+        if self.model.normalizer_input is not None:
+            u = self.model.normalizer_input.normalize(u)
+        seq_len = u.shape[-1]
+        # allocation
+        y_sample = torch.zeros(self.batch_size, m.y_dim, seq_len, device=m.device)
+        y_sample_mu = torch.zeros(self.batch_size, m.y_dim, seq_len, device=m.device)
+        y_sample_sigma = torch.zeros(self.batch_size, m.y_dim, seq_len, device=m.device)
+        h = self.h
+        with torch.no_grad():
+            for t in range(seq_len):
+                y_sample[:, :, t], y_sample_mu[:, :, t], y_sample_sigma[:, :, t], h = m.generate_step(u[:, :, t], h)
+        self.h = h
+        self.t += seq_len
+        return self._unnormalize(y_sample, y_sample_mu, y_sample_sigma)
+
+    def _unnormalize(self, y_sample, y_sample_mu, y_sample_sigma):
+        normalizer_output = self.model.normalizer_output
+        if normalizer_output is not None:
+            y_sample = normalizer_output.unnormalize(y_sample)
+            y_sample_mu = normalizer_output.unnormalize_mean(y_sample_mu)
+            y_sample_sigma = normalizer_output.unnormalize_sigma(y_sample_sigma)
+        return y_sample, y_sample_mu, y_sample_sigma
@@ -3,6 +3,7 @@ import torch.nn as nn
 import torch.utils
 import torch.utils.data
 import torch.distributions as tdist
+from .base import reset_state, select_valid
 
 """implementation of the STOchastich Recurent Neural network (STORN) from https://arxiv.org/abs/1411.7610 using
 unimodal isotropic gaussian distributions for inference, prior, and generating models."""
@@ -74,7 +75,7 @@ class STORN(nn.Module):
         # inference recurrence function (f_theta) -> Recurrence of d
         self.rnn_inf = nn.GRU(self.d_dim, self.d_dim, self.n_layers, bias)
 
-    def forward(self, u, y):
+    def forward(self, u, y, mask=None):
         #  batch size
         batch_size = y.shape[0]
         seq_len = y.shape[2]
@@ -92,6 +93,9 @@ class STORN(nn.Module):
 
         # for all time steps
         for t in range(seq_len):
+            # multi-trajectory batches: new trajectories start from a zero state
+            h = reset_state(h, mask, t)
+            d = reset_state(d, mask, t)
             # feature extraction: y_t
             phi_y_t = self.phi_y(y[:, :, t])
             # feature extraction: u_t
@@ -115,19 +119,18 @@ class STORN(nn.Module):
             dec_t = self.dec(h[-1])
             dec_mean_t = self.dec_mean(dec_t)
             dec_logvar_t = self.dec_logvar(dec_t)
-            pred_dist = tdist.Normal(dec_mean_t, dec_logvar_t.exp().sqrt())
 
             # recurrence: u_t+1, z_t, h_t -> h_t+1
             _, h = self.rnn_gen(torch.cat([phi_u_t, phi_z_t], 1).unsqueeze(0), h)
 
-            # computing the loss
-            KLD = self.kld_gauss(enc_mean_t, enc_logvar_t, prior_mean_t, prior_logvar_t)
-            loss_pred = torch.sum(pred_dist.log_prob(y[:, :, t]))
+            # computing the loss (padding of multi-trajectory batches does not count)
+            KLD = self.kld_gauss(*select_valid(mask, t, enc_mean_t, enc_logvar_t, prior_mean_t, prior_logvar_t))
+            loss_pred = self.loglikelihood_gauss(*select_valid(mask, t, y[:, :, t], dec_mean_t, dec_logvar_t))
             loss += - loss_pred + KLD
 
         return loss
 
-    def generate(self, u):
+    def generate(self, u, h=None, mask=None):
         # get the batch size
         batch_size = u.shape[0]
         # length of the sequence to generate
@@ -138,39 +141,61 @@ class STORN(nn.Module):
         sample_mu = torch.zeros(batch_size, self.y_dim, seq_len, device=self.device)
         sample_sigma = torch.zeros(batch_size, self.y_dim, seq_len, device=self.device)
 
-        h = torch.zeros(self.n_layers, batch_size, self.h_dim, device=self.device)
+        if h is None:
+            h = torch.zeros(self.n_layers, batch_size, self.h_dim, device=self.device)
+
+        # for all time steps
+        for t in range(seq_len):
+            h = reset_state(h, mask, t)
+            sample[:, :, t], sample_mu[:, :, t], sample_sigma[:, :, t], h = self.generate_step(u[:, :, t], h)
+
+        return sample, sample_mu, sample_sigma
+
+    def generate_step(self, u_t, h, sample=True):
+        # single step of the generating model: u_t+1, h_t -> y_t, h_t+1
+        # sample=False takes the means of z_t and y_t instead of samples (deterministic, e.g. for linearization)
+        # get the batch size
+        batch_size = u_t.shape[0]
 
-        # constnt so can be outside of loop
         # prior: z_t ~ N(0,1)
         prior_mean_t = torch.zeros([batch_size, self.z_dim], device=self.device)
         prior_logvar_t = torch.zeros([batch_size, self.z_dim], device=self.device)
 
-        # for all time steps
-        for t in range(seq_len):
-            # feature extraction: u_t+1
-            phi_u_t = self.phi_u(u[:, :, t])
+        # feature extraction: u_t+1
+        phi_u_t = self.phi_u(u_t)
 
-            # sampling and reparameterization: get new z_t
+        # sampling and reparameterization: get new z_t
+        if sample:
             temp = tdist.Normal(prior_mean_t, prior_logvar_t.exp().sqrt())
             z_t = tdist.Normal.rsample(temp)
-            # feature extraction: z_t
-            phi_z_t = self.phi_z(z_t)
+        else:
+            z_t = prior_mean_t
+        # feature extraction: z_t
+        phi_z_t = self.phi_z(z_t)
+
+        # decoder: h_t -> y_t
+        dec_t = self.dec(h[-1])
+        dec_mean_t = self.dec_mean(dec_t)
+        dec_logvar_t = self.dec_logvar(dec_t)
+        # store the samples
+        temp = tdist.Normal(dec_mean_t, dec_logvar_t.exp().sqrt())
+        sample_t = tdist.Normal.rsample(temp) if sample else dec_mean_t
+        # store mean and std
+        sample_mu_t = dec_mean_t
+        sample_sigma_t = dec_logvar_t.exp().sqrt()
+
+        # recurrence: u_t+1, z_t -> h_t+1
+        _, h = self.rnn_gen(torch.cat([phi_u_t, phi_z_t], 1).unsqueeze(0), h)
+
+        return sample_t, sample_mu_t, sample_sigma_t, h
 
-            # decoder: h_t -> y_t
-            dec_t = self.dec(h[-1])
-            dec_mean_t = self.dec_mean(dec_t)
-            dec_logvar_t = self.dec_logvar(dec_t)
-            # store the samples
-            temp = tdist.Normal(dec_mean_t, dec_logvar_t.exp().sqrt())
-            sample[:, :, t] = tdist.Normal.rsample(temp)
-            # store mean and std
-            sample_mu[:, :, t] = dec_mean_t
-            sample_sigma[:, :, t] = dec_logvar_t.exp().sqrt()
-
-            # recurrence: u_t+1, z_t -> h_t+1
-            _, h = self.rnn_gen(torch.cat([phi_u_t, phi_z_t], 1).unsqueeze(0), h)
+    @staticmethod
+    def loglikelihood_gauss(x, mu, logvar):
+        # log-likelihood of the data under the predictive distribution
+        pred_dist = tdist.Normal(mu, logvar.exp().sqrt())
+        loglike = torch.sum(pred_dist.log_prob(x))
 
-        return sample, sample_mu, sample_sigma
+        return loglike
 
     @staticmethod
     def kld_gauss(mu_q, logvar_q, mu_p, logvar_p):
@@ -1,6 +1,7 @@
 import torch
 import torch.nn as nn
 import torch.distributions as tdist
+from .base import reset_state, select_valid
 
 """VRNN-Gauss-I 
 modification of the VRNN-Gauss without the conditional prior. 
@@ -61,7 +62,7 @@ class VRNN_Gauss_I(nn.Module):
         # recurrence function (f_theta) -> Recurrence
         self.rnn = nn.GRU(self.h_dim + self.h_dim, self.h_dim, self.n_layers, bias)
 
-    def forward(self, u, y):
+    def forward(self, u, y, mask=None):
         #  batch size
         batch_size = y.shape[0]
         seq_len = y.shape[2]
@@ -77,6 +78,8 @@ class VRNN_Gauss_I(nn.Module):
 
         # for all time steps
         for t in range(seq_len):
+            # multi-trajectory batches: new trajectories start from a zero state
+            h = reset_state(h, mask, t)
             # feature extraction: y_t
             phi_y_t = self.phi_y(y[:, :, t])
             # feature extraction: u_t
@@ -97,19 +100,18 @@ class VRNN_Gauss_I(nn.Module):
             dec_t = self.dec(torch.cat([phi_z_t, h[-1]], 1))
             dec_mean_t = self.dec_mean(dec_t)
             dec_logvar_t = self.dec_logvar(dec_t)
-            pred_dist = tdist.Normal(dec_mean_t, dec_logvar_t.exp().sqrt())
 
             # recurrence: u_t+1, z_t -> h_t+1
             _, h = self.rnn(torch.cat([phi_u_t, phi_z_t], 1).unsqueeze(0), h)
 
-            # computing the loss
-            KLD = self.kld_gauss(enc_mean_t, enc_logvar_t, prior_mean_t, prior_logvar_t)
-            loss_pred = torch.sum(pred_dist.log_prob(y[:, :, t]))
+            # computing the loss (padding of multi-trajectory batches does not count)
+            KLD = self.kld_gauss(*select_valid(mask, t, enc_mean_t, enc_logvar_t, prior_mean_t, prior_logvar_t))
+            loss_pred = self.loglikelihood_gauss(*select_valid(mask, t, y[:, :, t], dec_mean_t, dec_logvar_t))
             loss += - loss_pred + KLD
 
         return loss
 
-    def generate(self, u):
+    def generate(self, u, h=None, mask=None):
         # get the batch size
         batch_size = u.shape[0]
         # length of the sequence to generate
@@ -120,39 +122,61 @@ class VRNN_Gauss_I(nn.Module):
         sample_mu = torch.zeros(batch_size, self.y_dim, seq_len, device=self.device)
         sample_sigma = torch.zeros(batch_size, self.y_dim, seq_len, device=self.device)
 
-        h = torch.zeros(self.n_layers, batch_size, self.h_dim, device=self.device)
+        if h is None:
+            h = torch.zeros(self.n_layers, batch_size, self.h_dim, device=self.device)
+
+        # for all time steps
+        for t in range(seq_len):
+            h = reset_state(h, mask, t)
+            sample[:, :, t], sample_mu[:, :, t], sample_sigma[:, :, t], h = self.generate_step(u[:, :, t], h)
+
+        return sample, sample_mu, sample_sigma
+
+    def generate_step(self, u_t, h, sample=True):
+        # single step of the generating model: u_t+1, h_t -> y_t, h_t+1
+        # sample=False takes the means of z_t and y_t instead of samples (deterministic, e.g. for linearization)
+        # get the batch size
+        batch_size = u_t.shape[0]
 
-        # constant so can be outside of loop
         # prior: z_t ~ N(0,1) (for KLD loss)
         prior_mean_t = torch.zeros([batch_size, self.z_dim], device=self.device)
         prior_logvar_t = torch.zeros([batch_size, self.z_dim], device=self.device)
 
-        # for all time steps
-        for t in range(seq_len):
-            # feature extraction: u_t+1
-            phi_u_t = self.phi_u(u[:, :, t])
+        # feature extraction: u_t+1
+        phi_u_t = self.phi_u(u_t)
 
-            # sampling and reparameterization: get new z_t
+        # sampling and reparameterization: get new z_t
+        if sample:
             temp = tdist.Normal(prior_mean_t, prior_logvar_t.exp().sqrt())
             z_t = tdist.Normal.rsample(temp)
-            # feature extraction: z_t
-            phi_z_t = self.phi_z(z_t)
+        else:
+            z_t = prior_mean_t
+        # feature extraction: z_t
+        phi_z_t = self.phi_z(z_t)
+
+        # decoder: z_t, h_t -> y_t
+        dec_t = self.dec(torch.cat([phi_z_t, h[-1]], 1))
+        dec_mean_t = self.dec_mean(dec_t)
+        dec_logvar_t = self.dec_logvar(dec_t)
+        # store the samples
+        temp = tdist.Normal(dec_mean_t, dec_logvar_t.exp().sqrt())
+        sample_t = tdist.Normal.rsample(temp) if sample else dec_mean_t
+        # store mean and std
+        sample_mu_t = dec_mean_t
+        sample_sigma_t = dec_logvar_t.exp().sqrt()
+
+        # recurrence: u_t+1, z_t -> h_t+1
+        _, h = self.rnn(torch.cat([phi_u_t, phi_z_t], 1).unsqueeze(0), h)
+
+        return sample_t, sample_mu_t, sample_sigma_t, h
 
-            # decoder: z_t, h_t -> y_t
-            dec_t = self.dec(torch.cat([phi_z_t, h[-1]], 1))
-            dec_mean_t = self.dec_mean(dec_t)
-            dec_logvar_t = self.dec_logvar(dec_t)
-            # store the samples
-            temp = tdist.Normal(dec_mean_t, dec_logvar_t.exp().sqrt())
-            sample[:, :, t] = tdist.Normal.rsample(temp)
-            # store mean and std
-            sample_mu[:, :, t] = dec_mean_t
-            sample_sigma[:, :, t] = dec_logvar_t.exp().sqrt()
-
-            # recurrence: u_t+1, z_t -> h_t+1
-            _, h = self.rnn(torch.cat([phi_u_t, phi_z_t], 1).unsqueeze(0), h)
+    @staticmethod
+    def loglikelihood_gauss(x, mu, logvar):
+        # log-likelihood of the data under the predictive distribution
+        pred_dist = tdist.Normal(mu, logvar.exp().sqrt())
+        loglike = torch.sum(pred_dist.log_prob(x))
 
-        return sample, sample_mu, sample_sigma
+        return loglike
 
     @staticmethod
     def kld_gauss(mu_q, logvar_q, mu_p, logvar_p):
@@ -2,6 +2,7 @@ import torch
 import torch.nn as nn
 from torch.nn import functional as F
 import torch.distributions as tdist
+from .base import reset_state, select_valid
 
 """implementation of the Variational Recurrent Neural Network (VRNN-GMM) from https://arxiv.org/abs/1506.02216 using
 Gaussian mixture distributions with fixed number of mixtures for inference, prior, and generating models."""
@@ -76,7 +77,7 @@ class VRNN_GMM(nn.Module):
         # recurrence function (f_theta) -> Recurrence
         self.rnn = nn.GRU(self.h_dim + self.h_dim, self.h_dim, self.n_layers, bias)
 
-    def forward(self, u, y):
+    def forward(self, u, y, mask=None):
 
         batch_size = y.size(0)
         seq_len = y.shape[-1]
@@ -88,6 +89,8 @@ class VRNN_GMM(nn.Module):
 
         # for all time steps
         for t in range(seq_len):
+            # multi-trajectory batches: new trajectories start from a zero state
+            h = reset_state(h, mask, t)
             # feature extraction: y_t
             phi_y_t = self.phi_y(y[:, :, t])
             # feature extraction: u_t
@@ -118,14 +121,14 @@ class VRNN_GMM(nn.Module):
             # recurrence: u_t+1, z_t -> h_t+1
             _, h = self.rnn(torch.cat([phi_u_t, phi_z_t], 1).unsqueeze(0), h)
 
-            # computing the loss
-            KLD = self.kld_gauss(enc_mean_t, enc_logvar_t, prior_mean_t, prior_logvar_t)
-            loss_pred = self.loglikelihood_gmm(y[:, :, t], dec_mean_t, dec_logvar_t, dec_pi_t)
+            # computing the loss (padding of multi-trajectory batches does not count)
+            KLD = self.kld_gauss(*select_valid(mask, t, enc_mean_t, enc_logvar_t, prior_mean_t, prior_logvar_t))
+            loss_pred = self.loglikelihood_gmm(*select_valid(mask, t, y[:, :, t], dec_mean_t, dec_logvar_t, dec_pi_t))
             loss += - loss_pred + KLD
 
         return loss
 
-    def generate(self, u):
+    def generate(self, u, h=None, mask=None):
         # get the batch size
         batch_size = u.shape[0]
         # length of the sequence to generate
@@ -136,39 +139,57 @@ class VRNN_GMM(nn.Module):
         sample_mu = torch.zeros(batch_size, self.y_dim, seq_len, device=self.device)
         sample_sigma = torch.zeros(batch_size, self.y_dim, seq_len, device=self.device)
 
-        h = torch.zeros(self.n_layers, batch_size, self.h_dim, device=self.device)
+        if h is None:
+            h = torch.zeros(self.n_layers, batch_size, self.h_dim, device=self.device)
 
         # for all time steps
         for t in range(seq_len):
-            # feature extraction: u_t+1
-            phi_u_t = self.phi_u(u[:, :, t])
-
-            # prior: h_t -> z_t
-            prior_t = self.prior(h[-1])
-            prior_mean_t = self.prior_mean(prior_t)
-            prior_logvar_t = self.prior_logvar(prior_t)
+            h = reset_state(h, mask, t)
+            sample[:, :, t], sample_mu[:, :, t], sample_sigma[:, :, t], h = self.generate_step(u[:, :, t], h)
 
-            # sampling and reparameterization: get new z_t
-            temp = tdist.Normal(prior_mean_t, prior_logvar_t.exp().sqrt())
-            z_t = tdist.Normal.rsample(temp)
-            # feature extraction: z_t
-            phi_z_t = self.phi_z(z_t)
+        return sample, sample_mu, sample_sigma
 
-            # decoder: z_t, h_t -> y_t
-            dec_t = self.dec(torch.cat([phi_z_t, h[-1]], 1))
-            dec_mean_t = self.dec_mean(dec_t).view(batch_size, self.y_dim, self.n_mixtures)
-            dec_logvar_t = self.dec_logvar(dec_t).view(batch_size, self.y_dim, self.n_mixtures)
-            dec_pi_t = self.dec_pi(dec_t).view(batch_size, self.y_dim, self.n_mixtures)
+    def generate_step(self, u_t, h, sample=True):
+        # single step of the generating model: u_t+1, h_t -> y_t, h_t+1
+        # sample=False takes the means of z_t and y_t instead of samples (deterministic, e.g. for linearization)
+        # get the batch size
+        batch_size = u_t.shape[0]
 
-            # store the samples
-            sample[:, :, t], sample_mu[:, :, t], sample_sigma[:, :, t] = self._reparameterized_sample_gmm(dec_mean_t,
-                                                                                                          dec_logvar_t,
-                                                                                                          dec_pi_t)
+        # feature extraction: u_t+1
+        phi_u_t = self.phi_u(u_t)
 
-            # recurrence: u_t+1, z_t -> h_t+1
-            _, h = self.rnn(torch.cat([phi_u_t, phi_z_t], 1).unsqueeze(0), h)
+        # prior: h_t -> z_t
+        prior_t = self.prior(h[-1])
+        prior_mean_t = self.prior_mean(prior_t)
+        prior_logvar_t = self.prior_logvar(prior_t)
 
-        return sample, sample_mu, sample_sigma
+        # sampling and reparameterization: get new z_t
+        if sample:
+            temp = tdist.Normal(prior_mean_t, prior_logvar_t.exp().sqrt())
+            z_t = tdist.Normal.rsample(temp)
+        else:
+            z_t = prior_mean_t
+        # feature extraction: z_t
+        phi_z_t = self.phi_z(z_t)
+
+        # decoder: z_t, h_t -> y_t
+        dec_t = self.dec(torch.cat([phi_z_t, h[-1]], 1))
+        dec_mean_t = self.dec_mean(dec_t).view(batch_size, self.y_dim, self.n_mixtures)
+        dec_logvar_t = self.dec_logvar(dec_t).view(batch_size, self.y_dim, self.n_mixtures)
+        dec_pi_t = self.dec_pi(dec_t).view(batch_size, self.y_dim, self.n_mixtures)
+
+        # store the samples
+        if sample:
+            sample_t, sample_mu_t, sample_sigma_t = self._reparameterized_sample_gmm(dec_mean_t, dec_logvar_t,
+                                                                                     dec_pi_t)
+        else:
+            sample_mu_t, sample_sigma_t = self._moments_gmm(dec_mean_t, dec_logvar_t, dec_pi_t)
+            sample_t = sample_mu_t
+
+        # recurrence: u_t+1, z_t -> h_t+1
+        _, h = self.rnn(torch.cat([phi_u_t, phi_z_t], 1).unsqueeze(0), h)
+
+        return sample_t, sample_mu_t, sample_sigma_t, h
 
     def _reparameterized_sample_gmm(self, mu, logvar, pi):
 
@@ -191,6 +212,13 @@ class VRNN_GMM(nn.Module):
 
         return sample, mu_sel, logvar_sel.exp().sqrt()
 
+    @staticmethod
+    def _moments_gmm(mu, logvar, pi):
+        # mean and std of the mixture
+        mean = (pi * mu).sum(-1)
+        var = (pi * (logvar.exp() + mu ** 2)).sum(-1) - mean ** 2
+        return mean, var.clamp(min=0).sqrt()
+
     def loglikelihood_gmm(self, x, mu, logvar, pi):
         # init
         loglike = 0
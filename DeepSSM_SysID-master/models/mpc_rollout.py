@@ -0,0 +1,117 @@
+import time
+import torch
+import torch.optim as optim
+# import user-written files
+from models.model_session import HiddenState, ModelSession
+
+"""rollouts of candidate input sequences for model-predictive control. The current hidden state (a single state or the
+particles of models/particle_filter.py with their log weights logw) is forked into all candidates by broadcasting it
+into the batch, the recurrence returns new states and never writes the forked one, hence it can be reused for every
+control period. All candidates and state samples are propagated as one batch with generate_step() over the horizon. The
+gradient of the expected cost with respect to u is obtained by backpropagation through the rollout, i.e. the adjoint
+recursion of the recurrence, which autograd runs for us."""
+
+
+def tracking_cost(y_mu, y_sigma, u, reference, lambda_du=0.):
+    # y_mu, y_sigma: (batch, ny, horizon), u: (batch, nu, horizon), reference: (ny, horizon) or (batch, ny, horizon)
+    # expectation of the squared tracking error under the decoder distribution plus a penalty on the input moves
+    cost = ((y_mu - reference) ** 2 + y_sigma ** 2).sum(dim=(1, 2))
+    if lambda_du > 0:
+        cost = cost + lambda_du * ((u[:, :, 1:] - u[:, :, :-1]) ** 2).sum(dim=(1, 2))
+    return cost
+
+
+class MPCRollout(object):
+    def __init__(self, model, horizon, cost=tracking_cost, n_samples=1, u_min=None, u_max=None):
+        # model: DynamicModel, cost(y_mu, y_sigma, u, reference) -> tensor of shape (batch,)
+        self.model = model
+        self.horizon = horizon
+        self.cost = cost
+        # samples of the latent path per candidate (and per state sample)
+        self.n_samples = n_samples
+        self.u_min = u_min
+        self.u_max = u_max
+        self.model.eval()
+
+    def initial_state(self, u_past):
+        # snapshot of the hidden state after the input history u_past: tensor, shape (1, nu, past_len)
+        session = ModelSession(self.model, batch_size=u_past.shape[0])
+        session.run(u_past)
+        return session.snapshot()
+
+    def rollout(self, h0, u, reference, requires_grad=True, logw=None):
+        # h0: HiddenState or tensor (n_layers, n_states, h_dim), u: (n_candidates, nu, horizon) unnormalized
+        # logw: log weights of the states, e.g. ParticleFilter.logw (uniform if None, i.e. only for resampled particles)
+        # returns the expected cost (n_candidates,) and its gradient with respect to u
+        m = self.model.m
+        if isinstance(h0, HiddenState):
+            h0 = h0.h
+        n_candidates = u.shape[0]
+        n_states = h0.shape[1] * self.n_samples
+        u = u.detach().requires_grad_(requires_grad)
+
+        with torch.set_grad_enabled(requires_grad):
+            # fork: candidate k uses all state samples, batch index k * n_states + s
+            h = h0.detach().repeat_interleave(self.n_samples, dim=1)
+            h = h.unsqueeze(1).expand(m.n_layers, n_candidates, n_states, m.h_dim)
+            h = h.reshape(m.n_layers, n_candidates * n_states, m.h_dim)
+
+            u_n = u if self.model.normalizer_input is None else self.model.normalizer_input.normalize(u)
+            u_n = u_n.repeat_interleave(n_states, dim=0)
+            y_mu = []
+            y_sigma = []
+            for t in range(self.horizon):
+                _, mu_t, sigma_t, h = m.generate_step(u_n[:, :, t], h)
+                y_mu.append(mu_t)
+                y_sigma.append(sigma_t)
+            y_mu = torch.stack(y_mu, dim=-1)
+            y_sigma = torch.stack(y_sigma, dim=-1)
+            if self.model.normalizer_output is not None:
+                y_mu = self.model.normalizer_output.unnormalize_mean(y_mu)
+                y_sigma = self.model.normalizer_output.unnormalize_sigma(y_sigma)
+
+            # expected cost: weighted average over the state samples of every candidate
+            cost = self.cost(y_mu, y_sigma, u.repeat_interleave(n_states, dim=0), reference)
+            cost = cost.view(n_candidates, n_states)
+            if logw is None:
+                cost = cost.mean(1)
+            else:
+                if logw.numel() != h0.shape[1]:
+                    raise Exception("logw must hold one weight per state of h0")
+                # the latent path samples of a state share its weight
+                w = torch.softmax(logw.detach().reshape(-1), dim=0).repeat_interleave(self.n_samples) / self.n_samples
+                cost = (cost * w.to(cost.dtype)).sum(1)
+
+        if not requires_grad:
+            return cost, None
+        # the candidates are independent, hence the gradient of the sum is the gradient of every candidate
+        grad, = torch.autograd.grad(cost.sum(), u)
+        return cost.detach(), grad
+
+    def optimize(self, h0, u_init, reference, budget, lr=1e-2, max_iter=100, logw=None):
+        # gradient descent on all candidates until the latency budget [s] is used up, returns the best candidate
+        # logw: weights of the particles in h0 (see rollout)
+        start = time.perf_counter()
+        u = u_init.detach().clone().requires_grad_(True)
+        optimizer = optim.Adam([u], lr=lr)
+        best_cost = float('inf')
+        best_u = u_init[0].detach().clone()
+        n_iter = 0
+        time_iter = 0
+        while n_iter < max_iter and time.perf_counter() - start + time_iter < budget:
+            start_iter = time.perf_counter()
+            cost, grad = self.rollout(h0, u, reference, logw=logw)
+            k = int(cost.argmin())
+            if cost[k] < best_cost:
+                best_cost = float(cost[k])
+                best_u = u[k].detach().clone()
+            optimizer.zero_grad()
+            u.grad = grad
+            optimizer.step()
+            if self.u_min is not None or self.u_max is not None:
+                with torch.no_grad():
+                    u.clamp_(self.u_min, self.u_max)
+            n_iter += 1
+            # stop before an iteration would exceed the budget
+            time_iter = time.perf_counter() - start_iter
+        return best_u, best_cost, n_iter
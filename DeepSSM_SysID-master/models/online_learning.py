@@ -0,0 +1,112 @@
+import copy
+import threading
+import time
+import numpy as np
+import torch
+import torch.optim as optim
+# import user-written files
+from data.sample_ring import SampleRing
+
+"""online fine-tuning of a deployed model on streaming plant data. The recent (u, y) samples are kept in a sample ring
+(data/sample_ring.py): the acquisition side is the producer, the training thread the consumer which releases the oldest
+samples such that the most recent buffer_size samples are kept and max_push samples always fit in. The training thread
+samples windows of the recent data and runs truncated BPTT updates (the recurrence is restarted at the beginning of
+every window) on a shadow copy of the model. Every swap_every updates a frozen copy of the shadow model replaces the
+serving model by a single reference assignment, hence predict() never waits for a lock or for the training step. It
+still shares the GIL and the torch thread pool with the training thread, the effect on the predict latency is measured
+with experiments/main_loadgen.py (loadopts['online_learning'])."""
+
+
+class OnlineLearner(object):
+    def __init__(self, modelstate, options, buffer_size=100000, seq_len=64, batch_size=32, lr=1e-4, swap_every=50,
+                 max_push=4096):
+        self.device = options['device']
+        self.seq_len = seq_len
+        self.batch_size = batch_size
+        self.swap_every = swap_every
+
+        # serving model, only replaced as a whole
+        self.serving = copy.deepcopy(modelstate.model).eval()
+        # shadow model which is trained in the background
+        self.shadow = copy.deepcopy(modelstate.model)
+        self.optimizer = getattr(optim, options['optim'])(self.shadow.parameters(), lr=lr)
+
+        # samples pushed between two training steps beyond max_push are dropped (counted in self.buffer.dropped)
+        self.buffer_size = buffer_size
+        self.buffer = SampleRing(buffer_size + max_push, modelstate.model.num_inputs, modelstate.model.num_outputs,
+                                 max_span=seq_len)
+        self.n_updates = 0
+        self.n_swaps = 0
+        self.last_loss = None
+        self._stop = threading.Event()
+        self._thread = None
+
+    def push(self, u, y):
+        # called from the acquisition side
+        self.buffer.push(u, y)
+
+    def predict(self, u):
+        # u: tensor, shape (batch, nu, seq_len); uses whichever model is serving at the time of the call
+        model = self.serving
+        with torch.no_grad():
+            return model.generate(u.to(self.device))
+
+    def step(self):
+        # single truncated BPTT update of the shadow model
+        batch = self.sample_windows()
+        if batch is None:
+            return False
+        u, y = batch
+        self.shadow.train()
+        self.optimizer.zero_grad()
+        loss_ = self.shadow(u.to(self.device), y.to(self.device))
+        loss_.backward()
+        self.optimizer.step()
+        self.last_loss = loss_.item() / np.prod(u.shape)
+        self.n_updates += 1
+
+        if self.n_updates % self.swap_every == 0:
+            self.swap()
+        return True
+
+    def sample_windows(self):
+        # random windows of the recent data in the (batch, channels, seq_len) layout of IODataset; only the training
+        # thread (consumer) calls this, the windows are copied before the oldest samples are released
+        self.buffer.advance(max(0, len(self.buffer) - self.buffer_size))
+        n = len(self.buffer)
+        if n < self.seq_len:
+            return None
+        windows = [self.buffer.window(self.seq_len, offset)
+                   for offset in np.random.randint(0, n - self.seq_len + 1, size=self.batch_size)]
+        u = np.stack([u_window for u_window, _ in windows])
+        y = np.stack([y_window for _, y_window in windows])
+        return torch.from_numpy(u), torch.from_numpy(y)
+
+    def swap(self):
+        # frozen copy of the shadow weights becomes the serving model (atomic reference assignment)
+        serving = copy.deepcopy(self.shadow).eval()
+        for p in serving.parameters():
+            p.requires_grad_(False)
+        self.serving = serving
+        self.n_swaps += 1
+
+    def _run(self, idle_sleep):
+        while not self._stop.is_set():
+            if not self.step():
+                time.sleep(idle_sleep)
+
+    def start(self, idle_sleep=0.01):
+        self._stop.clear()
+        self._thread = threading.Thread(target=self._run, args=(idle_sleep,), daemon=True)
+        self._thread.start()
+
+    def stop(self):
+        self._stop.set()
+        if self._thread is not None:
+            self._thread.join()
+            self._thread = None
+
+    def save_model(self, modelstate, epoch, path, name='model.pt'):
+        # store the current serving weights with the ModelState checkpoint format
+        modelstate.model.load_state_dict(self.serving.state_dict())
+        modelstate.save_model(epoch, self.last_loss, 0, path, name)
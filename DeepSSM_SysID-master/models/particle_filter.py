@@ -0,0 +1,150 @@
+import contextlib
+import numpy as np
+import torch
+import torch.distributions as tdist
+# import user-written files
+from models.model_session import HiddenState
+
+"""sequential Monte Carlo (bootstrap particle filter) for online state estimation with a trained model. Every particle
+carries the GRU state h_t. In each step the particles draw z_t from the prior of the model, the decoder gives
+p(y_t|z_t,h_t) and the recurrence gives h_t+1, see generate_step() of the models. The particles are weighted with the
+decoder likelihood of the measured y_t and resampled (systematic resampling) when the effective sample size drops.
+All particles of all batch elements are propagated as one batch of size batch_size * n_particles, hence the torch
+kernels run them in parallel on all cores (set n_threads to limit this, only during step() / filter()).
+For the GMM models the sampled mixture component is part of the particle, i.e. a particle is weighted with the
+likelihood of its own component."""
+
+
+def systematic_resample(weights):
+    # weights: tensor, shape (batch, n_particles), normalized along dim 1; returns ancestor indices of the same shape
+    batch_size, n_particles = weights.shape
+    cdf = torch.cumsum(weights, dim=1)
+    # guard against round-off in the last bin
+    cdf[:, -1] = 1.
+    # one uniform offset per batch element, evenly spaced positions
+    positions = (torch.rand(batch_size, 1, device=weights.device, dtype=weights.dtype) +
+                 torch.arange(n_particles, device=weights.device, dtype=weights.dtype)) / n_particles
+    idx = torch.searchsorted(cdf, positions)
+    return idx.clamp_(max=n_particles - 1)
+
+
+class ParticleFilter(object):
+    def __init__(self, model, n_particles=1000, resample_threshold=0.5, n_threads=None):
+        # model: DynamicModel (with normalizers), inputs and outputs of the filter are unnormalized
+        self.model = model
+        self.n_particles = n_particles
+        # resample when the effective sample size drops below resample_threshold * n_particles
+        self.resample_threshold = resample_threshold
+        self.n_threads = n_threads
+        self.model.eval()
+        self.reset()
+
+    def reset(self, batch_size=1, state=None):
+        # all particles start from the zero state or from a HiddenState snapshot (e.g. after a known prefix)
+        m = self.model.m
+        if state is None:
+            state = HiddenState.zeros(self.model, batch_size)
+        self.batch_size = state.batch_size
+        self.h = state.fork(self.n_particles).h
+        self.logw = torch.full([self.batch_size, self.n_particles], -np.log(self.n_particles), device=m.device)
+        # log p(y_1:t|u_1:t) of every batch element
+        self.loglikelihood = torch.zeros(self.batch_size, device=m.device)
+        self.n_resampled = 0
+        self.t = 0
+
+    @contextlib.contextmanager
+    def _threads(self):
+        # threads of the torch kernels while filtering, the previous number is restored afterwards
+        n_torch_threads = torch.get_num_threads()
+        if self.n_threads is not None:
+            torch.set_num_threads(self.n_threads)
+        try:
+            yield
+        finally:
+            torch.set_num_threads(n_torch_threads)
+
+    def step(self, u_t, y_t=None):
+        # u_t: tensor, shape (batch, nu), y_t: tensor, shape (batch, ny) or None if no measurement is available
+        # returns the one-step-ahead prediction of y_t given y_1:t-1 (mean, std) and the effective sample size
+        with self._threads():
+            return self._step(u_t, y_t)
+
+    def _step(self, u_t, y_t=None):
+        batch_size, n_particles = self.batch_size, self.n_particles
+        with torch.no_grad():
+            u_t = self._normalize(self.model.normalizer_input, u_t)
+
+            # propagate: z_t ~ p(z_t|h_t), p(y_t|z_t,h_t), h_t+1
+            _, mu, sigma, h = self.model.m.generate_step(u_t.repeat_interleave(n_particles, dim=0), self.h)
+
+            # predictive distribution: moments of the weighted mixture of the particles
+            w = self.logw.exp()[..., None]
+            mu = mu.view(batch_size, n_particles, -1)
+            sigma = sigma.view(batch_size, n_particles, -1)
+            y_mu = (w * mu).sum(1)
+            y_sigma = ((w * (sigma ** 2 + mu ** 2)).sum(1) - y_mu ** 2).clamp(min=0).sqrt()
+
+            if y_t is not None:
+                # weight with the decoder likelihood of the measurement
+                y_t = self._normalize(self.model.normalizer_output, y_t)
+                loglike = tdist.Normal(mu, sigma).log_prob(y_t[:, None, :]).sum(-1)
+                logw = self.logw + loglike
+                lognorm = torch.logsumexp(logw, dim=1)
+                logw = logw - lognorm[:, None]
+                self.loglikelihood += lognorm - self._logscale(self.model.normalizer_output)
+
+                # resample where the weights degenerated
+                w = logw.exp()
+                ess = 1. / (w ** 2).sum(1)
+                resample = ess < self.resample_threshold * n_particles
+                if resample.any():
+                    idx = systematic_resample(w)
+                    keep = torch.arange(n_particles, device=idx.device).expand(batch_size, n_particles)
+                    idx = torch.where(resample[:, None], idx, keep)
+                    idx = idx + n_particles * torch.arange(batch_size, device=idx.device)[:, None]
+                    h = h[:, idx.view(-1), :]
+                    logw = torch.where(resample[:, None], torch.full_like(logw, -np.log(n_particles)), logw)
+                    self.n_resampled += int(resample.sum())
+                self.logw = logw
+            else:
+                ess = 1. / (self.logw.exp() ** 2).sum(1)
+            self.h = h
+            self.t += 1
+
+        y_mu = self._unnormalize(self.model.normalizer_output, y_mu, mean=True)
+        y_sigma = self._unnormalize(self.model.normalizer_output, y_sigma, mean=False)
+        return y_mu, y_sigma, ess
+
+    def filter(self, u, y):
+        # u: tensor, shape (batch, nu, seq_len), y: tensor, shape (batch, ny, seq_len); runs the filter from the reset
+        # state, returns the one-step-ahead predictions (batch, ny, seq_len) and the effective sample sizes
+        self.reset(u.shape[0])
+        seq_len = u.shape[-1]
+        y_mu = torch.zeros(u.shape[0], y.shape[1], seq_len, device=u.device)
+        y_sigma = torch.zeros(u.shape[0], y.shape[1], seq_len, device=u.device)
+        ess = torch.zeros(u.shape[0], seq_len, device=u.device)
+        with self._threads():
+            for t in range(seq_len):
+                y_mu[:, :, t], y_sigma[:, :, t], ess[:, t] = self._step(u[:, :, t], y[:, :, t])
+        return y_mu, y_sigma, ess
+
+    @staticmethod
+    def _normalize(normalizer, x):
+        if normalizer is None:
+            return x
+        return normalizer.normalize(x.unsqueeze(-1)).squeeze(-1)
+
+    @staticmethod
+    def _unnormalize(normalizer, x, mean=True):
+        if normalizer is None:
+            return x
+        if mean:
+            return normalizer.unnormalize_mean(x.unsqueeze(-1)).squeeze(-1)
+        return normalizer.unnormalize_sigma(x.unsqueeze(-1)).squeeze(-1)
+
+    @staticmethod
+    def _logscale(normalizer):
+        # change of variables of the likelihood from normalized to original units
+        if normalizer is None:
+            return 0.
+        return normalizer.scale.log().sum()
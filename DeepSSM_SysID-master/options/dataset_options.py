@@ -29,6 +29,8 @@ def get_dataset_options(dataset_name):
         dataset_parser.add_argument('--seq_len_train', type=int, default=2000, help='training sequence length')
         dataset_parser.add_argument('--seq_len_test', type=int, default=None, help='test sequence length')
         dataset_parser.add_argument('--seq_len_val', type=int, default=2000, help='validation sequence length')  # 512
+        dataset_parser.add_argument('--no_cache', dest='cache', action='store_false',
+                                    help='always generate the data, bypass the dataset cache')
         dataset_options = dataset_parser.parse_args()
 
     elif dataset_name == 'toy_lgssm':
@@ -38,6 +40,8 @@ def get_dataset_options(dataset_name):
         dataset_parser.add_argument('--seq_len_train', type=int, default=64, help='training sequence length')
         dataset_parser.add_argument('--seq_len_test', type=int, default=None, help='test sequence length')
         dataset_parser.add_argument('--seq_len_val', type=int, default=64, help='validation sequence length')  # 512
+        dataset_parser.add_argument('--no_cache', dest='cache', action='store_false',
+                                    help='always generate the data, bypass the dataset cache')
         dataset_options = dataset_parser.parse_args()
 
     elif dataset_name == 'wiener_hammerstein':
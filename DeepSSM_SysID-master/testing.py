@@ -4,9 +4,11 @@ import numpy as np
 # import user-writte files
 import utils.datavisualizer as dv
 import utils.dataevaluater as de
+import utils.renderer as renderer
 from utils.utils import get_n_params
 from models.model_state import ModelState
 from utils.utils import compute_normalizer
+from utils.memory_tracker import memtracker, tensor_bytes
 
 
 def run_test(options, loaders, df, path_general, file_name_general, **kwargs):
@@ -36,8 +38,10 @@ def run_test(options, loaders, df, path_general, file_name_general, **kwargs):
     modelstate.load_model(path, file_name)
     modelstate.model.to(options['device'])
 
-    # %% plot and save the loss curve
-    dv.plot_losscurve(df, options, path_general, file_name_general)
+    # %% plot and save the loss curve (in the background, the loss values are removed from df right away)
+    renderer.render(options, dv.plot_losscurve, df, options, path_general, file_name_general, removedata=False)
+    df.pop('all_losses', None)
+    df.pop('all_vlosses', None)
 
     # %% others
 
@@ -56,10 +60,14 @@ def run_test(options, loaders, df, path_general, file_name_general, **kwargs):
     # %%
 
     # %% sample from the model
-    for i, (u_test, y_test) in enumerate(loaders['test']):
+    for i, (u_test, y_test, *mask) in enumerate(loaders['test']):
         # getting output distribution parameter only implemented for selected models
         u_test = u_test.to(options['device'])
-        y_sample, y_sample_mu, y_sample_sigma = modelstate.model.generate(u_test)
+        # reset mask of multi-trajectory datasets (the state starts from zero for every trajectory)
+        mask = mask[0].to(options['device']) if mask else None
+        with torch.no_grad(), memtracker.scope('test'):
+            y_sample, y_sample_mu, y_sample_sigma = modelstate.model.generate(u_test, mask=mask)
+        memtracker.track('eval_buffers', tensor_bytes([u_test, y_sample, y_sample_mu, y_sample_sigma]))
 
         # convert to cpu and to numpy for evaluation
         # samples data
@@ -102,14 +110,15 @@ def run_test(options, loaders, df, path_general, file_name_general, **kwargs):
         temp = 4000
     else:
         temp = 200
-    dv.plot_time_sequence_uncertainty(data_y_true,
-                                      data_y_sample,
-                                      label_y,
-                                      options,
-                                      batch_show=0,
-                                      x_limit_show=[0, temp],
-                                      path_general=path_general,
-                                      file_name_general=file_name_general)
+    renderer.render(options, dv.plot_time_sequence_uncertainty,
+                    data_y_true,
+                    data_y_sample,
+                    label_y,
+                    options,
+                    batch_show=0,
+                    x_limit_show=[0, temp],
+                    path_general=path_general,
+                    file_name_general=file_name_general)
 
     # %% compute performance values
 
@@ -122,6 +131,11 @@ def run_test(options, loaders, df, path_general, file_name_general, **kwargs):
     # compute RMSE
     rmse = de.compute_rmse(y_test_noisy, y_sample_mu, doprint=True)
 
+    # output memory usage per phase
+    memtracker.track_model(modelstate)
+    memtracker.track_loaders([loaders['test']])
+    memtracker.print_summary('run_test')
+
     # %% Collect data
 
     # options_dict
@@ -5,26 +5,51 @@ import torch.utils
 import torch.utils.data
 import numpy as np
 import time
+from utils.profiler import StepProfiler
+from utils.memory_tracker import memtracker
+from utils.logger import log_record
 
 
 def run_train(modelstate, loader_train, loader_valid, options, dataframe, path_general, file_name_general):
-    def validate(loader):
+    # data parallel training: only the first process saves and prints, gradients are summed by the reducer
+    is_main = options.get('rank', 0) == 0
+    grad_reducer = options.get('grad_reducer', None)
+    # training loss over all shards, evaluated by the first process only
+    loader_train_eval = options.get('loader_train_eval', loader_train)
+
+    def n_points(u, mask):
+        # number of input values, without the padding of multi-trajectory batches
+        if mask is None:
+            return np.prod(u.shape)
+        return (mask > 0).sum().item() * u.shape[1]
+
+    def evaluate(loader):
         modelstate.model.eval()
         total_vloss = 0
         total_batches = 0
         total_points = 0
-        with torch.no_grad():
-            for i, (u, y) in enumerate(loader):
+        with torch.no_grad(), memtracker.scope('validation'):
+            for i, (u, y, *mask) in enumerate(loader):
                 u = u.to(options['device'])
                 y = y.to(options['device'])
-                vloss_ = modelstate.model(u, y)
+                mask = mask[0].to(options['device']) if mask else None
+                vloss_ = modelstate.model(u, y, mask)
 
                 total_batches += u.size()[0]
-                total_points += np.prod(u.shape)
+                total_points += n_points(u, mask)
                 total_vloss += vloss_.item()
 
         return total_vloss / total_points  # total_batches
 
+    def validate(loader):
+        if grad_reducer is None:
+            return evaluate(loader)
+        # data parallel: the validation noise is drawn from the seed common to all processes (identical lr schedule),
+        # the training noise of the process is not advanced
+        with torch.random.fork_rng():
+            torch.manual_seed(options['seed'])
+            return evaluate(loader)
+
     def train(epoch):
         # model in training mode
         modelstate.model.train()
@@ -32,29 +57,39 @@ def run_train(modelstate, loader_train, loader_valid, options, dataframe, path_g
         total_loss = 0
         total_batches = 0
         total_points = 0
+        # new deterministic shuffle of the data shards
+        if hasattr(loader_train.sampler, 'set_epoch'):
+            loader_train.sampler.set_epoch(epoch)
 
-        for i, (u, y) in enumerate(loader_train):
+        for i, (u, y, *mask) in enumerate(loader_train):
             u = u.to(options['device'])
             y = y.to(options['device'])
+            # reset / padding mask of multi-trajectory datasets
+            mask = mask[0].to(options['device']) if mask else None
 
             # set the optimizer
             modelstate.optimizer.zero_grad()
             # forward pass over model
-            loss_ = modelstate.model(u, y)
+            with memtracker.scope('forward', activations=True):
+                loss_ = modelstate.model(u, y, mask)
             # NN optimization
-            loss_.backward()
+            with memtracker.scope('backward'):
+                loss_.backward()
+            if grad_reducer is not None:
+                grad_reducer.finalize()
             modelstate.optimizer.step()
 
             total_batches += u.size()[0]
-            total_points += np.prod(u.shape)
+            total_points += n_points(u, mask)
             total_loss += loss_.item()
 
             # output to console
-            if i % train_options.print_every == 0:
+            if i % train_options.print_every == 0 and is_main:
                 print(
                     'Train Epoch: [{:5d}/{:5d}], Batch [{:6d}/{:6d} ({:3.0f}%)]\tLearning rate: {:.2e}\tLoss: {:.3f}'.format(
                         epoch, train_options.n_epochs, (i + 1), len(loader_train),
                         100. * (i + 1) / len(loader_train), lr, total_loss / total_points))  # total_batches
+                log_record(epoch=epoch, batch=i + 1, lr=lr, loss=total_loss / total_points)
 
         return total_loss / total_points
 
@@ -62,16 +97,24 @@ def run_train(modelstate, loader_train, loader_valid, options, dataframe, path_g
         model_options = options['model_options']
         train_options = options['train_options']
 
+        # attach the step profiler to all submodules (nothing is registered if disabled)
+        if options.get('profile', False):
+            step_profiler = StepProfiler()
+            step_profiler.attach(modelstate.model)
+
         modelstate.model.train()
         # Train
         vloss = validate(loader_valid)
+        init_vloss = vloss
         all_losses = []
         all_vlosses = []
+        # wall time of every validation [s since the start of the training]
+        all_vloss_times = []
         best_vloss = vloss
         start_time = time.time()
 
-        # Extract initial learning rate
-        lr = train_options.init_lr
+        # Extract initial learning rate (of the optimizer, a loaded checkpoint may continue with a reduced one)
+        lr = modelstate.optimizer.param_groups[0]['lr']
 
         # output parameter
         best_epoch = 0
@@ -82,24 +125,28 @@ def run_train(modelstate, loader_train, loader_valid, options, dataframe, path_g
             # validate every n epochs
             if epoch % train_options.test_every == 0:
                 vloss = validate(loader_valid)
-                loss = validate(loader_train)
+                loss = validate(loader_train_eval) if is_main else float('nan')
                 # Save losses
                 all_losses += [loss]
                 all_vlosses += [vloss]
+                all_vloss_times += [time.time() - start_time]
 
                 if vloss < best_vloss:  # epoch == train_options.n_epochs:  #
                     best_vloss = vloss
                     # save model
                     path = path_general + 'model/'
                     file_name = file_name_general + '_bestModel.ckpt'
-                    modelstate.save_model(epoch, vloss, time.process_time() - start_time, path, file_name)
+                    if is_main:
+                        modelstate.save_model(epoch, vloss, time.process_time() - start_time, path, file_name)
                     # torch.save(model.state_dict(), path + file_name)
                     best_epoch = epoch
 
                 # Print validation results
-                print('Train Epoch: [{:5d}/{:5d}], Batch [{:6d}/{:6d} ({:3.0f}%)]\tLearning rate: {:.2e}\tLoss: {:.3f}'
-                      '\tVal Loss: {:.3f}'.format(epoch, train_options.n_epochs, len(loader_train), len(loader_train),
-                                                  100., lr, loss, vloss))
+                if is_main:
+                    print('Train Epoch: [{:5d}/{:5d}], Batch [{:6d}/{:6d} ({:3.0f}%)]\tLearning rate: {:.2e}\tLoss: {:.3f}'
+                          '\tVal Loss: {:.3f}'.format(epoch, train_options.n_epochs, len(loader_train),
+                                                      len(loader_train), 100., lr, loss, vloss))
+                    log_record(epoch=epoch, batch=len(loader_train), lr=lr, loss=loss, vloss=vloss)
 
                 # lr scheduler
                 if epoch >= train_options.lr_scheduler_nstart:
@@ -110,7 +157,8 @@ def run_train(modelstate, loader_train, loader_valid, options, dataframe, path_g
                         # adapt new learning rate in the optimizer
                         for param_group in modelstate.optimizer.param_groups:
                             param_group['lr'] = lr
-                        print('\nLearning rate adapted! New learning rate {:.3e}\n'.format(lr))
+                        if is_main:
+                            print('\nLearning rate adapted! New learning rate {:.3e}\n'.format(lr))
                 # Early stoping condition
                 if lr < train_options.min_lr:
                     break
@@ -129,9 +177,22 @@ def run_train(modelstate, loader_train, loader_valid, options, dataframe, path_g
     time_el = time.time() - start_time
     # print('\nTotal learning time: {:2.0f}:{:2.0f} [min:sec]'.format(time_el // 60, time_el - 60 * (time_el // 60)))
 
+    # output and save the step profile
+    if options.get('profile', False):
+        step_profiler.detach()
+        step_profiler.print_summary()
+        step_profiler.save_chrome_trace(path_general + 'profile/', file_name_general + '_trace.json')
+
+    # output memory usage per phase
+    memtracker.track_model(modelstate)
+    memtracker.track_loaders([loader_train, loader_valid])
+    memtracker.print_summary('run_train')
+
     # save data in dictionary
     train_dict = {'all_losses': all_losses,
                   'all_vlosses': all_vlosses,
+                  'all_vloss_times': all_vloss_times,
+                  'init_vloss': init_vloss,
                   'best_epoch': best_epoch,
                   'total_epoch': epoch,
                   'train_time': time_el}
@@ -0,0 +1,200 @@
+import os
+import copy
+import time
+import multiprocessing as mp
+import torch
+# import user-written files
+import data.loader as loader
+import training
+import testing
+from models.model_state import ModelState
+from utils.utils import compute_normalizer
+from utils.results_store import ResultsStore, run_row
+
+"""asynchronous successive halving (ASHA, https://arxiv.org/abs/1810.05934) for the grid search. All grid points start
+on the lowest rung with min_epochs of training. Whenever a worker is free, a grid point which is in the top 1/eta of
+the finished grid points of its rung (by validation loss) is promoted to the next rung and continues from its
+checkpoint, otherwise a new grid point is started. The remaining grid points are stopped early."""
+
+
+class ASHAScheduler(object):
+    def __init__(self, n_trials, min_epochs, max_epochs, eta=3):
+        self.n_trials = n_trials
+        self.eta = eta
+        # cumulative number of epochs per rung
+        self.budgets = []
+        budget = min_epochs
+        while budget < max_epochs:
+            self.budgets.append(budget)
+            budget *= eta
+        self.budgets.append(max_epochs)
+        # validation loss of the finished trials and promoted trials per rung
+        self.rungs = [{} for _ in self.budgets]
+        self.promoted = [set() for _ in self.budgets]
+        self.next_trial = 0
+
+    def get_job(self):
+        # promote from the highest possible rung first
+        for k in reversed(range(len(self.budgets) - 1)):
+            finished = self.rungs[k]
+            top = sorted(finished, key=finished.get)[:len(finished) // self.eta]
+            for trial in top:
+                if trial not in self.promoted[k]:
+                    self.promoted[k].add(trial)
+                    return trial, k + 1
+        # otherwise start a new trial
+        if self.next_trial < self.n_trials:
+            self.next_trial += 1
+            return self.next_trial - 1, 0
+        return None
+
+    def report(self, trial, rung, vloss):
+        self.rungs[rung][trial] = vloss
+
+    def epochs(self, rung):
+        # epochs to train on this rung
+        return self.budgets[rung] - (self.budgets[rung - 1] if rung > 0 else 0)
+
+
+def get_file_name(file_name_general, point):
+    return file_name_general + '_h{}_z{}_n{}'.format(*point)
+
+
+def setup_model(options, kwargs, point):
+    # set new values in options
+    options['model_options'].h_dim, options['model_options'].z_dim, options['model_options'].n_layers = point
+
+    # Specifying datasets
+    loaders = loader.load_dataset(dataset=options["dataset"],
+                                  dataset_options=options["dataset_options"],
+                                  train_batch_size=options["train_options"].batch_size,
+                                  test_batch_size=options["test_options"].batch_size,
+                                  **kwargs)
+
+    # Compute normalizers
+    if options["normalize"]:
+        normalizer_input, normalizer_output = compute_normalizer(loaders['train'])
+    else:
+        normalizer_input = normalizer_output = None
+
+    # Define model
+    modelstate = ModelState(seed=options["seed"],
+                            nu=loaders["train"].nu, ny=loaders["train"].ny,
+                            model=options["model"],
+                            options=options,
+                            normalizer_input=normalizer_input,
+                            normalizer_output=normalizer_output)
+    modelstate.model.to(options['device'])
+
+    return loaders, modelstate
+
+
+def train_job(options, kwargs, point, rung, n_epochs, path_general, file_name_general, n_threads):
+    # runs in a worker process
+    torch.set_num_threads(n_threads)
+    options = copy.deepcopy(options)
+    file_name = get_file_name(file_name_general, point)
+    path = path_general + 'model/'
+    ckpt_name = file_name + '_bestModel.ckpt'
+
+    loaders, modelstate = setup_model(options, kwargs, point)
+    # continue from the checkpoint of the previous rung (model, optimizer and its learning rate)
+    if rung > 0:
+        modelstate.load_model(path, ckpt_name)
+    else:
+        # initial weights, kept if the validation loss never improves during the first rung
+        modelstate.save_model(0, float('inf'), 0., path, ckpt_name)
+
+    # run_train trains for n_epochs + 1 epochs
+    options['train_options'].n_epochs = n_epochs - 1
+    df = training.run_train(modelstate=modelstate,
+                            loader_train=loaders['train'],
+                            loader_valid=loaders['valid'],
+                            options=options,
+                            dataframe={},
+                            path_general=path_general,
+                            file_name_general=file_name)
+
+    # the checkpoint holds the best model of all rungs so far
+    ckpt = torch.load(path + ckpt_name, map_location=lambda storage, loc: storage)
+    if ckpt['vloss'] == float('inf'):
+        # no improvement on the first rung: the initial weights with the validation loss run_train started from
+        ckpt['vloss'] = df['init_vloss']
+        torch.save(ckpt, path + ckpt_name)
+    vloss = ckpt['vloss']
+
+    return point, rung, vloss, df
+
+
+def test_job(options, kwargs, point, df, path_general, file_name_general, n_threads):
+    # runs in a worker process
+    torch.set_num_threads(n_threads)
+    options = copy.deepcopy(options)
+    options['showfig'] = False
+    options['model_options'].h_dim, options['model_options'].z_dim, options['model_options'].n_layers = point
+    loaders = loader.load_dataset(dataset=options["dataset"],
+                                  dataset_options=options["dataset_options"],
+                                  train_batch_size=options["train_options"].batch_size,
+                                  test_batch_size=options["test_options"].batch_size,
+                                  **kwargs)
+    # loss curves for the results store, run_test removes them from df
+    loss_curves = {name: df.get(name, []) for name in ('all_losses', 'all_vlosses')}
+    df = testing.run_test(options, loaders, df, path_general, get_file_name(file_name_general, point))
+    # workers append to the same store
+    ResultsStore(path_general + 'data/results/').append(run_row(options, df, **loss_curves))
+    return df
+
+
+def run_asha_gridsearch(options, kwargs, points, path_general, file_name_general):
+    # scheduler settings
+    asha_options = options['asha_options']
+    n_workers = asha_options['n_workers']
+    n_threads = max(1, os.cpu_count() // n_workers)
+    scheduler = ASHAScheduler(len(points), asha_options['min_epochs'], options['train_options'].n_epochs,
+                              asha_options['eta'])
+    print('ASHA rungs [epochs]: {}'.format(scheduler.budgets))
+
+    # workers are forked, the main files change the working directory on import and can not be spawned
+    all_df = {point: {'all_losses': [], 'all_vlosses': [], 'train_time': 0} for point in points}
+    ctx = mp.get_context('fork')
+    with ctx.Pool(processes=n_workers) as pool:
+        running = {}
+        while True:
+            # fill all free workers
+            while len(running) < n_workers:
+                job = scheduler.get_job()
+                if job is None:
+                    break
+                trial, rung = job
+                print('ASHA: start h={}, z={}, n={} on rung {} ({} epochs)'.format(*points[trial], rung,
+                                                                                   scheduler.epochs(rung)))
+                running[job] = pool.apply_async(train_job, (options, kwargs, points[trial], rung,
+                                                            scheduler.epochs(rung), path_general,
+                                                            file_name_general, n_threads))
+            if not running:
+                break
+
+            # collect the finished jobs
+            finished = [job for job, result in running.items() if result.ready()]
+            if not finished:
+                time.sleep(0.1)
+                continue
+            for job in finished:
+                point, rung, vloss, df = running.pop(job).get()
+                scheduler.report(job[0], rung, vloss)
+                print('ASHA: finished h={}, z={}, n={} on rung {} with vloss={:.4f}'.format(*point, rung, vloss))
+                # append the training history of this rung
+                all_df[point]['all_losses'] += df['all_losses']
+                all_df[point]['all_vlosses'] += df['all_vlosses']
+                all_df[point]['train_time'] += df['train_time']
+                all_df[point]['total_epoch'] = scheduler.budgets[rung]
+                all_df[point]['rung'] = rung
+
+        # test the best checkpoints of all grid points
+        if options['do_test']:
+            results = [pool.apply_async(test_job, (options, kwargs, point, all_df[point], path_general,
+                                                   file_name_general, n_threads)) for point in points]
+            for point, result in zip(points, results):
+                all_df[point] = result.get()
+
+    return all_df
@@ -0,0 +1,134 @@
+import copy
+import torch
+import torch.nn as nn
+# import user-written files
+import utils.dataevaluater as de
+
+"""evaluation of many checkpoints of the same architecture with a single generate. The checkpoints are loaded into one
+stacked model: every nn.Linear and nn.GRU of the model is replaced by a layer holding the weights of all N models which
+runs model k on the k-th block of the batch (batched matrix products). The batch of the stacked model is the test input
+repeated N times, hence the unchanged generate() of the model runs all N models at once. The metrics of every
+checkpoint are computed and handed out as soon as the stacked generate is done."""
+
+
+class StackedLinear(nn.Module):
+    def __init__(self, linears):
+        super(StackedLinear, self).__init__()
+        self.weight = torch.stack([linear.weight.detach() for linear in linears]).transpose(1, 2)
+        self.bias = None if linears[0].bias is None else torch.stack([linear.bias.detach() for linear in linears])
+
+    def forward(self, x):
+        # x: (n_models * batch, in_features), model k gets rows k * batch ... (k + 1) * batch - 1
+        n_models = self.weight.shape[0]
+        x = x.reshape(n_models, -1, x.shape[-1])
+        if self.bias is None:
+            y = torch.bmm(x, self.weight)
+        else:
+            y = torch.baddbmm(self.bias.unsqueeze(1), x, self.weight)
+        return y.reshape(-1, y.shape[-1])
+
+
+class StackedGRU(nn.Module):
+    def __init__(self, grus):
+        super(StackedGRU, self).__init__()
+        self.n_layers = grus[0].num_layers
+        self.h_dim = grus[0].hidden_size
+        self.bias = grus[0].bias
+
+        def stack(name):
+            return torch.stack([getattr(gru, name).detach() for gru in grus])
+
+        self.weight_ih = [stack('weight_ih_l{}'.format(l)).transpose(1, 2) for l in range(self.n_layers)]
+        self.weight_hh = [stack('weight_hh_l{}'.format(l)).transpose(1, 2) for l in range(self.n_layers)]
+        if self.bias:
+            self.bias_ih = [stack('bias_ih_l{}'.format(l)).unsqueeze(1) for l in range(self.n_layers)]
+            self.bias_hh = [stack('bias_hh_l{}'.format(l)).unsqueeze(1) for l in range(self.n_layers)]
+
+    def forward(self, x, h):
+        # x: (seq_len, n_models * batch, input_size), h: (n_layers, n_models * batch, h_dim), same equations as nn.GRU
+        n_models = self.weight_ih[0].shape[0]
+        h = [h[l].reshape(n_models, -1, self.h_dim) for l in range(self.n_layers)]
+        output = []
+        for t in range(x.shape[0]):
+            x_t = x[t].reshape(n_models, -1, x.shape[-1])
+            for l in range(self.n_layers):
+                gi = torch.bmm(x_t, self.weight_ih[l])
+                gh = torch.bmm(h[l], self.weight_hh[l])
+                if self.bias:
+                    gi = gi + self.bias_ih[l]
+                    gh = gh + self.bias_hh[l]
+                i_r, i_z, i_n = gi.chunk(3, -1)
+                h_r, h_z, h_n = gh.chunk(3, -1)
+                r = torch.sigmoid(i_r + h_r)
+                z = torch.sigmoid(i_z + h_z)
+                n = torch.tanh(i_n + r * h_n)
+                h[l] = (1 - z) * n + z * h[l]
+                x_t = h[l]
+            output.append(x_t.reshape(-1, self.h_dim))
+        return torch.stack(output), torch.stack([h_l.reshape(-1, self.h_dim) for h_l in h])
+
+
+def stack_models(models):
+    # models: list of VRNN_Gauss, STORN, ... with identical architecture
+    stacked = copy.deepcopy(models[0])
+    for name, module in models[0].named_modules():
+        if isinstance(module, nn.Linear):
+            layer = StackedLinear([model.get_submodule(name) for model in models])
+        elif isinstance(module, nn.GRU):
+            layer = StackedGRU([model.get_submodule(name) for model in models])
+        else:
+            continue
+        parent_name, _, child_name = name.rpartition('.')
+        setattr(stacked.get_submodule(parent_name), child_name, layer)
+    return stacked.eval()
+
+
+def load_models(modelstate, files):
+    # one copy of the DynamicModel of modelstate per checkpoint (files saved by ModelState.save_model)
+    models = []
+    for file in files:
+        model = copy.deepcopy(modelstate.model)
+        model.load_state_dict(torch.load(file, map_location=lambda storage, loc: storage)['model'])
+        models.append(model.eval())
+    return models
+
+
+def generate_stacked(models, u):
+    # u: tensor, shape (batch, nu, seq_len); returns y_sample, y_sample_mu, y_sample_sigma of shape
+    # (n_models, batch, ny, seq_len) (unnormalized with the normalizers of every model)
+    n_models = len(models)
+    batch_size, nu, seq_len = u.shape
+    u = u.unsqueeze(0).repeat(n_models, 1, 1, 1)
+    if models[0].normalizer_input is not None:
+        scale = torch.stack([model.normalizer_input.scale for model in models])[:, None, :, None]
+        offset = torch.stack([model.normalizer_input.offset for model in models])[:, None, :, None]
+        u = (u - offset) / scale
+
+    stacked = stack_models([model.m for model in models])
+    with torch.no_grad():
+        y_sample, y_sample_mu, y_sample_sigma = stacked.generate(u.reshape(n_models * batch_size, nu, seq_len))
+    y_sample, y_sample_mu, y_sample_sigma = [y.reshape(n_models, batch_size, -1, seq_len)
+                                             for y in (y_sample, y_sample_mu, y_sample_sigma)]
+
+    if models[0].normalizer_output is not None:
+        scale = torch.stack([model.normalizer_output.scale for model in models])[:, None, :, None]
+        offset = torch.stack([model.normalizer_output.offset for model in models])[:, None, :, None]
+        y_sample = y_sample * scale + offset
+        y_sample_mu = y_sample_mu * scale + offset
+        y_sample_sigma = y_sample_sigma * scale
+    return y_sample, y_sample_mu, y_sample_sigma
+
+
+def evaluate_checkpoints(modelstate, files, u_test, y_test, chunk_size=None):
+    # u_test: tensor (batch, nu, seq_len), y_test: ndarray (batch, ny, seq_len) to compare with (e.g. noisy test data)
+    # yields (file, performance values) for every checkpoint, chunk_size checkpoints are stacked at once (default all)
+    chunk_size = len(files) if chunk_size is None else chunk_size
+    for k0 in range(0, len(files), chunk_size):
+        chunk = files[k0:k0 + chunk_size]
+        _, y_sample_mu, y_sample_sigma = generate_stacked(load_models(modelstate, chunk), u_test)
+        y_sample_mu = y_sample_mu.cpu().numpy()
+        y_sample_sigma = y_sample_sigma.cpu().numpy()
+        for k, file in enumerate(chunk):
+            yield file, {'marginal_likeli': de.compute_marginalLikelihood(y_test, y_sample_mu[k], y_sample_sigma[k]),
+                         'vaf': de.compute_vaf(y_test, y_sample_mu[k]),
+                         'rmse': de.compute_rmse(y_test, y_sample_mu[k])}
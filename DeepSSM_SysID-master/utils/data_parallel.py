@@ -0,0 +1,222 @@
+import os
+import copy
+import queue
+import threading
+import traceback
+import multiprocessing as mp
+import torch
+from torch.utils.data.distributed import DistributedSampler
+# import user-written files
+import training
+from data.base import DataLoaderExt
+
+"""data parallel training on N local processes without any network. The processes are forked from the main process,
+every process trains on its own deterministic shard of the training data and the gradients are summed through a
+shared memory buffer. The gradients are reduced in buckets (in reverse parameter order) by a background thread as
+soon as all gradients of a bucket are available, hence the reduction overlaps with the backward pass. Each process
+reduces its own part of each bucket (reduce-scatter) and all processes read the complete result (all-gather).
+The losses are sums over the batch, so summing the gradients gives the gradient of the global batch.
+The sampling noise of the training is seeded per process (seed + rank), as for independent samples of the global
+batch. The validation runs on a forked random state seeded with the common seed, thus the validation loss (and with
+it the learning rate schedule) is identical on all processes and the models stay synchronized. The training loss is
+evaluated on the complete training data by the first process. If a process fails, the barrier is aborted and the main
+process stops all processes and raises the error."""
+
+
+class SharedMemoryReducer(object):
+    def __init__(self, params, slots, result, barrier, rank, world_size, bucket_size=2 ** 16):
+        self.params = [p for p in params if p.requires_grad]
+        self.slots = slots  # shape (world_size, numel), one row per process
+        self.result = result  # shape (numel), reduced gradients
+        self.barrier = barrier
+        self.rank = rank
+        self.world_size = world_size
+
+        # flat layout of all gradients and buckets in reverse parameter order
+        self.offsets = {}
+        self.buckets = []
+        offset = 0
+        bucket = []
+        for p in reversed(self.params):
+            self.offsets[p] = offset
+            offset += p.numel()
+            bucket.append(p)
+            if sum(q.numel() for q in bucket) >= bucket_size:
+                self.buckets.append(bucket)
+                bucket = []
+        if bucket:
+            self.buckets.append(bucket)
+        self.bucket_of = {p: b for b, bucket in enumerate(self.buckets) for p in bucket}
+
+        # synchronization between the backward pass and the reducer thread
+        self._lock = threading.Lock()
+        self._pending = [len(bucket) for bucket in self.buckets]
+        self._marked = set()
+        self._ready = [threading.Event() for _ in self.buckets]
+        self._done = [threading.Event() for _ in self.buckets]
+        self._error = None
+
+        # gradient hooks are called once per backward pass with the complete gradient of the parameter
+        self._handles = [p.register_hook(self._hook(p)) for p in self.params]
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+
+    @staticmethod
+    def numel(params):
+        return sum(p.numel() for p in params if p.requires_grad)
+
+    def _hook(self, p):
+        def hook(grad):
+            self._mark(p, grad)
+            return grad
+        return hook
+
+    def _mark(self, p, grad):
+        offset = self.offsets[p]
+        if grad is None:
+            self.slots[self.rank, offset:offset + p.numel()].zero_()
+        else:
+            self.slots[self.rank, offset:offset + p.numel()].copy_(grad.detach().reshape(-1))
+        with self._lock:
+            self._marked.add(p)
+            b = self.bucket_of[p]
+            self._pending[b] -= 1
+            if self._pending[b] == 0:
+                self._ready[b].set()
+
+    def _run(self):
+        # reduce the buckets in fixed order, the same on all processes
+        while True:
+            for b, bucket in enumerate(self.buckets):
+                self._ready[b].wait()
+                self._ready[b].clear()
+                start = self.offsets[bucket[0]]
+                end = self.offsets[bucket[-1]] + bucket[-1].numel()
+                # part of this process
+                chunk = (end - start + self.world_size - 1) // self.world_size
+                lo = min(start + self.rank * chunk, end)
+                hi = min(lo + chunk, end)
+                try:
+                    # all gradients of this bucket are written
+                    self.barrier.wait()
+                    torch.sum(self.slots[:, lo:hi], dim=0, out=self.result[lo:hi])
+                    # all parts of this bucket are reduced
+                    self.barrier.wait()
+                except threading.BrokenBarrierError:
+                    # another process failed or the barrier timed out, finalize raises in the training thread
+                    self._error = 'gradient reduction aborted (another process failed or timed out)'
+                    for done in self._done:
+                        done.set()
+                    return
+                self._done[b].set()
+
+    def finalize(self):
+        # parameters without gradient in this backward pass (e.g. unused prior of STORN) contribute zeros
+        for p in self.params:
+            if p not in self._marked:
+                self._mark(p, None)
+        for done in self._done:
+            done.wait()
+        if self._error is not None:
+            raise Exception(self._error)
+        # write back reduced gradients
+        for p in self.params:
+            offset = self.offsets[p]
+            reduced = self.result[offset:offset + p.numel()].view_as(p)
+            if p.grad is None:
+                p.grad = reduced.clone()
+            else:
+                p.grad.copy_(reduced)
+        # prepare for next step
+        with self._lock:
+            self._marked = set()
+            self._pending = [len(bucket) for bucket in self.buckets]
+        for done in self._done:
+            done.clear()
+
+    def remove(self):
+        for handle in self._handles:
+            handle.remove()
+
+
+def _worker(rank, world_size, modelstate, loader_train, loader_valid, options, path_general, file_name_general,
+            slots, result, barrier, queue):
+    torch.set_num_threads(max(1, os.cpu_count() // world_size))
+    options = dict(options)
+
+    # deterministic shard of the training data, global batch size is kept
+    train_options = copy.deepcopy(options['train_options'])
+    train_options.batch_size = max(1, train_options.batch_size // world_size)
+    options['train_options'] = train_options
+    sampler = DistributedSampler(loader_train.dataset, num_replicas=world_size, rank=rank, shuffle=True,
+                                 seed=options['seed'])
+    loader_shard = DataLoaderExt(loader_train.dataset, batch_size=train_options.batch_size, sampler=sampler,
+                                 num_workers=0)
+
+    # independent training noise on every process
+    torch.manual_seed(options['seed'] + rank)
+
+    options['rank'] = rank
+    options['loader_train_eval'] = loader_train
+    options['grad_reducer'] = SharedMemoryReducer(modelstate.model.parameters(), slots, result, barrier, rank,
+                                                  world_size)
+    try:
+        df = training.run_train(modelstate=modelstate,
+                                loader_train=loader_shard,
+                                loader_valid=loader_valid,
+                                options=options,
+                                dataframe={},
+                                path_general=path_general,
+                                file_name_general=file_name_general)
+    except Exception:
+        # release the other processes waiting in the barrier and report to the main process
+        barrier.abort()
+        queue.put(('error', rank, traceback.format_exc()))
+        raise
+    if rank == 0:
+        queue.put(('done', rank, df))
+
+
+def run_train_data_parallel(modelstate, loader_train, loader_valid, options, dataframe, path_general,
+                            file_name_general, n_processes):
+    # shared memory for the gradients of all processes, allocated before forking
+    numel = SharedMemoryReducer.numel(modelstate.model.parameters())
+    slots = torch.zeros(n_processes, numel).share_memory_()
+    result = torch.zeros(numel).share_memory_()
+
+    # the main files change the working directory on import, hence fork instead of spawn
+    ctx = mp.get_context('fork')
+    barrier = ctx.Barrier(n_processes, timeout=options.get('barrier_timeout', 600.))
+    reports = ctx.Queue()
+    processes = [ctx.Process(target=_worker, args=(rank, n_processes, modelstate, loader_train, loader_valid,
+                                                   options, path_general, file_name_general, slots, result,
+                                                   barrier, reports))
+                 for rank in range(n_processes)]
+    for process in processes:
+        process.start()
+
+    # wait for the result of the first process, stop all processes if one of them fails
+    df = None
+    while df is None:
+        try:
+            status, rank, value = reports.get(timeout=1.)
+        except queue.Empty:
+            failed = [rank for rank, process in enumerate(processes) if process.exitcode not in (None, 0)]
+            if not failed:
+                continue
+            status, rank, value = 'error', failed[0], 'exit code {}'.format(processes[failed[0]].exitcode)
+        if status == 'error':
+            barrier.abort()
+            for process in processes:
+                process.terminate()
+                process.join()
+            raise Exception("Data parallel training failed in process {}:\n{}".format(rank, value))
+        df = value
+    for process in processes:
+        process.join()
+
+    # load the best model of the training into this process
+    modelstate.load_model(path_general + 'model/', file_name_general + '_bestModel.ckpt')
+    dataframe.update(df)
+
+    return dataframe
@@ -82,3 +82,78 @@ def compute_marginalLikelihood(y, yhat_mu, yhat_sigma, doprint=False):
         print('Marginal Likelihood / point = {:.3f}'.format(marg_likelihood))
 
     return marg_likelihood
+
+
+# estimates the period length (in samples) of a periodic signal u: (..., seq_len), None if it is not periodic
+def find_period(u, rtol=1e-3):
+    u = np.asarray(u).reshape(-1, np.shape(u)[-1])
+    seq_len = u.shape[-1]
+    # circular autocorrelation (zero padded) of all channels, the period is one of its largest peaks
+    u_f = np.fft.rfft(u - u.mean(-1, keepdims=True), n=2 * seq_len, axis=-1)
+    acorr = np.fft.irfft(np.abs(u_f) ** 2, axis=-1).sum(0)[1:seq_len // 2 + 1]
+    for period in np.argsort(-acorr)[:10] + 1:
+        if np.max(np.abs(u[:, period:] - u[:, :-period])) <= rtol * np.max(np.abs(u)):
+            return int(period)
+    return None
+
+
+# frequency domain evaluation of the steady-state response to a periodic (multisine) input
+def compute_frequency_response(y, yhat, period_len, u=None, fs=1., n_transient=0, f_band=None, doprint=False):
+    # y, yhat: (batch, ny, seq_len), u: (batch, nu, seq_len); the first n_transient samples are discarded, afterwards
+    # all complete periods are transformed at once (one batched FFT over batch, channels and periods).
+    # returns the spectra averaged over the periods on the excited lines, the error per harmonic, the noise floor of y
+    # (variance of the period mean, needs >= 2 periods), the FRF Y/U of data and model (if u is given) and the relative
+    # error in the band f_band = (f_min, f_max)
+    def periods(x):
+        x = np.asarray(x)[..., n_transient:]
+        n_periods = x.shape[-1] // period_len
+        return x[..., :n_periods * period_len].reshape(*x.shape[:-1], n_periods, period_len)
+
+    Y = np.fft.rfft(periods(y), axis=-1)
+    Yhat = np.fft.rfft(periods(yhat), axis=-1)
+    n_periods = Y.shape[-2]
+    freqs = np.fft.rfftfreq(period_len, 1 / fs)
+
+    Y_mean = Y.mean(-2)
+    Yhat_mean = Yhat.mean(-2)
+    if n_periods > 1:
+        noise_floor = (np.abs(Y - Y_mean[..., None, :]) ** 2).sum(-2) / (n_periods * (n_periods - 1))
+    else:
+        noise_floor = np.full(Y_mean.shape, np.nan)
+
+    # excited lines: from the input if available, else from the measured output
+    if u is not None:
+        U_mean = np.fft.rfft(periods(u), axis=-1).mean(-2)
+        power = (np.abs(U_mean) ** 2).sum((0, 1))
+    else:
+        power = (np.abs(Y_mean) ** 2).sum((0, 1))
+    excited = power > 1e-6 * power.max()
+    excited[0] = False
+    if f_band is not None:
+        excited &= (freqs >= f_band[0]) & (freqs <= f_band[1])
+
+    error = Yhat_mean - Y_mean
+    rel_error = (np.abs(error[..., excited]) ** 2).sum((0, 2)) / (np.abs(Y_mean[..., excited]) ** 2).sum((0, 2))
+
+    results = {'freqs': freqs[excited],
+               'Y': Y_mean[..., excited],
+               'Yhat': Yhat_mean[..., excited],
+               'error': error[..., excited],
+               'noise_floor': noise_floor[..., excited],
+               'rel_error': rel_error,
+               'n_periods': n_periods}
+    if u is not None:
+        # single input: FRF per output, (batch, ny, n_lines)
+        results['frf'] = results['Y'] / U_mean[:, :1, excited]
+        results['frf_model'] = results['Yhat'] / U_mean[:, :1, excited]
+
+    # print output
+    if doprint:
+        for i in range(rel_error.shape[0]):
+            print('Relative error y{} on {} excited lines = {:.2f} dB'.format(i + 1, int(excited.sum()),
+                                                                               10 * np.log10(rel_error[i])))
+        if n_periods > 1:
+            print('Noise floor / output power = {:.2f} dB'.format(
+                10 * np.log10(results['noise_floor'].sum() / (np.abs(results['Y']) ** 2).sum())))
+
+    return results
@@ -4,6 +4,62 @@ import numpy as np
 import os
 
 
+# %% decimation of long series: the plotted number of points is proportional to the width of the figure in pixels
+def n_points_figure(points_per_pixel=2):
+    fig = plt.gcf()
+    return int(points_per_pixel * fig.get_figwidth() * fig.dpi)
+
+
+def lttb(x, y, n_out):
+    # largest-triangle-three-buckets: indices of n_out points of (x, y) keeping the shape of the curve (and its peaks)
+    n = len(y)
+    if n_out >= n or n_out < 3:
+        return np.arange(n)
+    # n_out - 2 buckets for the inner points, the first and the last point are always kept
+    edges = np.linspace(1, n - 1, n_out - 1).astype(int)
+    idx = np.zeros(n_out, dtype=int)
+    idx[-1] = n - 1
+    a = 0
+    for i in range(n_out - 2):
+        lo, hi = edges[i], edges[i + 1]
+        # average point of the next bucket
+        next_lo, next_hi = (edges[i + 1], edges[i + 2]) if i + 2 < n_out - 1 else (n - 1, n)
+        x_avg = x[next_lo:next_hi].mean()
+        y_avg = y[next_lo:next_hi].mean()
+        # point of the bucket spanning the largest triangle with the last chosen point and the average point
+        area = np.abs((x[a] - x_avg) * (y[lo:hi] - y[a]) - (x[a] - x[lo:hi]) * (y_avg - y[a]))
+        a = lo + int(np.argmax(area))
+        idx[i + 1] = a
+    return idx
+
+
+def minmax(x, lower, upper, n_out):
+    # envelope of a band with n_out points: minimum of lower and maximum of upper per bucket (two points per bucket)
+    n = len(x)
+    if n <= n_out:
+        return x, lower, upper
+    edges = np.linspace(0, n, n_out // 2 + 1).astype(int)
+    x_out = np.stack([x[edges[:-1]], x[edges[1:] - 1]], -1).reshape(-1)
+    lower_out = np.repeat(np.minimum.reduceat(lower, edges[:-1]), 2)
+    upper_out = np.repeat(np.maximum.reduceat(upper, edges[:-1]), 2)
+    return x_out, lower_out, upper_out
+
+
+def plot_mean_band(x, mu, std, n_sigma, label, facecolor, x_limit=None):
+    # plots mu and the band mu +- n_sigma * std, both decimated to the visible part of the series
+    x = np.asarray(x)
+    mu = np.asarray(mu)
+    std = np.asarray(std)
+    if x_limit is not None:
+        visible = (x >= x_limit[0]) & (x <= x_limit[1])
+        x, mu, std = x[visible], mu[visible], std[visible]
+    n_points = n_points_figure()
+    idx = lttb(x, mu, n_points)
+    plt.plot(x[idx], mu[idx], label=label)
+    x_band, lower, upper = minmax(x, mu - n_sigma * std, mu + n_sigma * std, n_points)
+    plt.fill_between(x_band, lower, upper, alpha=0.3, facecolor=facecolor)
+
+
 # %% plots the resulting time sequence
 def plot_time_sequence_uncertainty(data_y_true, data_y_sample, label_y, options, path_general, file_name_general,
                                    batch_show, x_limit_show):
@@ -25,29 +81,26 @@ def plot_time_sequence_uncertainty(data_y_true, data_y_sample, label_y, options,
         # output yk
         plt.subplot(num_outputs, num_cols, num_cols * (j + 1))
         if len(data_y_true) == 1:  # plot samples
-            plt.plot(data_y_true[0][batch_show, j, :].squeeze(), label='y_{}(k) {}'.format(j + 1, label_y[0]))
+            y = data_y_true[0][batch_show, j, :].squeeze()
+            x = np.arange(len(y))
+            if x_limit_show is not None:
+                visible = (x >= x_limit_show[0]) & (x <= x_limit_show[1])
+                x, y = x[visible], y[visible]
+            idx = lttb(x, y, n_points_figure())
+            plt.plot(x[idx], y[idx], label='y_{}(k) {}'.format(j + 1, label_y[0]))
         else:  # plot true mu /pm 3sigma
             length = len(data_y_true[0][batch_show, j, :])
             x = np.linspace(0, length - 1, length)
             mu = data_y_true[0][batch_show, j, :].squeeze()
             std = data_y_true[1][batch_show, j, :].squeeze()
-            # plot mean
-            plt.plot(mu, label='y_{}(k) {}'.format(j + 1, label_y[0]))
-            # plot 3std around
-            plt.fill_between(x, mu, mu + 3 * std, alpha=0.3, facecolor='b')
-            plt.fill_between(x, mu, mu - 3 * std, alpha=0.3, facecolor='b')
+            plot_mean_band(x, mu, std, 3, 'y_{}(k) {}'.format(j + 1, label_y[0]), 'b', x_limit_show)
 
         # plot samples mu \pm 3sigma
         length = len(data_y_sample[0][batch_show, j, :])
         x = np.linspace(0, length - 1, length)
         mu = data_y_sample[0][batch_show, j, :].squeeze()
         std = data_y_sample[1][batch_show, j, :].squeeze()
-
-        # plot mean
-        plt.plot(mu, label='y_{}(k) {}'.format(j + 1, label_y[1]))
-        # plot 3std around
-        plt.fill_between(x, mu, mu + 3 * std, alpha=0.3, facecolor='r')
-        plt.fill_between(x, mu, mu - 3 * std, alpha=0.3, facecolor='r')
+        plot_mean_band(x, mu, std, 3, 'y_{}(k) {}'.format(j + 1, label_y[1]), 'r', x_limit_show)
 
         # plot settings
         plt.title('Output $y_{}(k)$, {} with (h,z,n)=({},{},{})'.format((j + 1),
@@ -88,8 +141,12 @@ def plot_losscurve(df, options, path_general, file_name_general, removedata=True
         # plot loss curve
         plt.figure(1, figsize=(5, 5))
         xval = np.linspace(0, options['train_options'].test_every * (len(all_losses) - 1), len(all_losses))
-        plt.plot(xval, all_losses, label='Training set')
-        plt.plot(xval, all_vlosses, label='Validation set')  # loss_test_store_idx,
+        all_losses = np.asarray(all_losses)
+        all_vlosses = np.asarray(all_vlosses)
+        idx = lttb(xval, all_losses, n_points_figure())
+        plt.plot(xval[idx], all_losses[idx], label='Training set')
+        idx = lttb(xval, all_vlosses, n_points_figure())
+        plt.plot(xval[idx], all_vlosses[idx], label='Validation set')  # loss_test_store_idx,
         plt.xlabel('Number Epochs in {:2.0f}:{:2.0f} [min:sec]'.format(time_el // 60,
                                                                        time_el - 60 * (time_el // 60)))
         plt.ylabel('Loss')
@@ -128,11 +185,8 @@ def plot_perf_ndata(k_max_train_values, all_vaf, all_rmse, all_likelihood, optio
     mu = all_vaf.mean(0).squeeze().numpy()
     std = np.sqrt(all_vaf.var(0)).squeeze().numpy()
     plt.subplot(3, 1, 1)
-    # plot mean
-    plt.plot(x, mu, label='VAF $\mu\pm\sigma$')
-    # plot std
-    plt.fill_between(x, mu, mu + std, alpha=0.3, facecolor='b')
-    plt.fill_between(x, mu, mu - std, alpha=0.3, facecolor='b')
+    # plot mean and std
+    plot_mean_band(x, mu, std, 1, 'VAF $\mu\pm\sigma$', 'b')
     # plot settings
     plt.title('VAF of {}'.format(options['dataset']))
     plt.xlabel('Training Datapoints')
@@ -143,11 +197,8 @@ def plot_perf_ndata(k_max_train_values, all_vaf, all_rmse, all_likelihood, optio
     mu = all_rmse.mean(0).squeeze().numpy()
     std = np.sqrt(all_rmse.var(0)).squeeze().numpy()
     plt.subplot(3, 1, 2)
-    # plot mean
-    plt.plot(x, mu, label='RMSE $\mu\pm\sigma$')
-    # plot std
-    plt.fill_between(x, mu, mu + std, alpha=0.3, facecolor='b')
-    plt.fill_between(x, mu, mu - std, alpha=0.3, facecolor='b')
+    # plot mean and std
+    plot_mean_band(x, mu, std, 1, 'RMSE $\mu\pm\sigma$', 'b')
     # plot settings
     plt.title('RMSE of {}'.format(options['dataset']))
     plt.xlabel('Training Datapoints')
@@ -158,11 +209,8 @@ def plot_perf_ndata(k_max_train_values, all_vaf, all_rmse, all_likelihood, optio
     mu = -all_likelihood.mean(0).squeeze().numpy()
     std = np.sqrt((-all_likelihood).var(0)).squeeze().numpy()
     plt.subplot(3, 1, 3)
-    # plot mean
-    plt.plot(x, mu, label='NLL $\mu\pm\sigma$')
-    # plot std
-    plt.fill_between(x, mu, mu + std, alpha=0.3, facecolor='b')
-    plt.fill_between(x, mu, mu - std, alpha=0.3, facecolor='b')
+    # plot mean and std
+    plot_mean_band(x, mu, std, 1, 'NLL $\mu\pm\sigma$', 'b')
     # plot settings
     plt.title('NLL of {}'.format(options['dataset']))
     plt.xlabel('Training Datapoints')
@@ -193,11 +241,8 @@ def plot_perf_sizes(h_values, all_vaf, all_rmse, all_likelihood, options, path_g
     mu = all_vaf.mean(0).squeeze().numpy()
     std = np.sqrt(all_vaf.var(0)).squeeze().numpy()
     plt.subplot(3, 1, 1)
-    # plot mean
-    plt.plot(x, mu, label='VAF $\mu\pm\sigma$')
-    # plot std
-    plt.fill_between(x, mu, mu + std, alpha=0.3, facecolor='b')
-    plt.fill_between(x, mu, mu - std, alpha=0.3, facecolor='b')
+    # plot mean and std
+    plot_mean_band(x, mu, std, 1, 'VAF $\mu\pm\sigma$', 'b')
     # plot settings
     plt.title('VAF of {}'.format(options['dataset']))
     plt.xlabel('Training Datapoints')
@@ -208,11 +253,8 @@ def plot_perf_sizes(h_values, all_vaf, all_rmse, all_likelihood, options, path_g
     mu = all_rmse.mean(0).squeeze().numpy()
     std = np.sqrt(all_rmse.var(0)).squeeze().numpy()
     plt.subplot(3, 1, 2)
-    # plot mean
-    plt.plot(x, mu, label='RMSE $\mu\pm\sigma$')
-    # plot std
-    plt.fill_between(x, mu, mu + std, alpha=0.3, facecolor='b')
-    plt.fill_between(x, mu, mu - std, alpha=0.3, facecolor='b')
+    # plot mean and std
+    plot_mean_band(x, mu, std, 1, 'RMSE $\mu\pm\sigma$', 'b')
     # plot settings
     plt.title('RMSE of {}'.format(options['dataset']))
     plt.xlabel('Training Datapoints')
@@ -223,11 +265,8 @@ def plot_perf_sizes(h_values, all_vaf, all_rmse, all_likelihood, options, path_g
     mu = -all_likelihood.mean(0).squeeze().numpy()
     std = np.sqrt((-all_likelihood).var(0)).squeeze().numpy()
     plt.subplot(3, 1, 3)
-    # plot mean
-    plt.plot(x, mu, label='NLL $\mu\pm\sigma$')
-    # plot std
-    plt.fill_between(x, mu, mu + std, alpha=0.3, facecolor='b')
-    plt.fill_between(x, mu, mu - std, alpha=0.3, facecolor='b')
+    # plot mean and std
+    plot_mean_band(x, mu, std, 1, 'NLL $\mu\pm\sigma$', 'b')
     # plot settings
     plt.title('NLL of {}'.format(options['dataset']))
     plt.xlabel('Training Datapoints')
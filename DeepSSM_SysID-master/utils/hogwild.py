@@ -0,0 +1,193 @@
+import os
+import copy
+import json
+import time
+import threading
+import numpy as np
+import torch
+import torch.optim as optim
+from torch.utils.data import SubsetRandomSampler
+# import user-written files
+from data.base import DataLoaderExt
+
+"""Hogwild training (https://arxiv.org/abs/1106.5730) for the small models. All parameters are moved into one
+contiguous buffer. Every thread has its own replica of the model whose parameters are views of this buffer, but with
+its own gradients and optimizer state. The threads run forward/backward on different minibatches and update the shared
+buffer without any locks. The torch kernels release the GIL, hence the threads run in parallel."""
+
+
+def share_parameters(model, flat=None):
+    # let all parameters of the model be views of one contiguous buffer
+    params = [p for p in model.parameters()]
+    if flat is None:
+        flat = torch.cat([p.detach().reshape(-1) for p in params])
+    offset = 0
+    for p in params:
+        p.data = flat[offset:offset + p.numel()].view_as(p)
+        offset += p.numel()
+    return flat
+
+
+def _worker(replica, optimizer, loader, device, losses, idx):
+    replica.train()
+    total_loss = 0
+    total_points = 0
+    for u, y, *mask in loader:
+        u = u.to(device)
+        y = y.to(device)
+        # reset / padding mask of multi-trajectory datasets
+        mask = mask[0].to(device) if mask else None
+        optimizer.zero_grad()
+        loss_ = replica(u, y, mask)
+        loss_.backward()
+        # lock-free update of the shared parameters
+        optimizer.step()
+        total_loss += loss_.item()
+        total_points += np.prod(u.shape) if mask is None else (mask > 0).sum().item() * u.shape[1]
+    losses[idx] = (total_loss, total_points)
+
+
+def run_train_hogwild(modelstate, loader_train, loader_valid, options, dataframe, path_general, file_name_general,
+                      n_threads):
+    def validate(loader):
+        modelstate.model.eval()
+        total_vloss = 0
+        total_points = 0
+        with torch.no_grad():
+            for u, y, *mask in loader:
+                u = u.to(options['device'])
+                y = y.to(options['device'])
+                mask = mask[0].to(options['device']) if mask else None
+                total_vloss += modelstate.model(u, y, mask).item()
+                total_points += np.prod(u.shape) if mask is None else (mask > 0).sum().item() * u.shape[1]
+        return total_vloss / total_points
+
+    train_options = options['train_options']
+    # threads of the torch kernels per hogwild thread, restored at the end
+    n_torch_threads = torch.get_num_threads()
+    torch.set_num_threads(max(1, os.cpu_count() // n_threads))
+
+    # shared parameters and one replica with own optimizer per thread
+    flat = share_parameters(modelstate.model)
+    replicas = []
+    optimizers = []
+    for _ in range(n_threads):
+        replica = copy.deepcopy(modelstate.model)
+        share_parameters(replica, flat)
+        replicas.append(replica)
+        optimizers.append(getattr(optim, options['optim'])(replica.parameters(), lr=train_options.init_lr))
+
+    # every thread draws its minibatches from its own part of the data
+    indices = np.random.permutation(len(loader_train.dataset))
+    loaders = [DataLoaderExt(loader_train.dataset, batch_size=train_options.batch_size,
+                             sampler=SubsetRandomSampler(indices[k::n_threads].tolist()), num_workers=0)
+               for k in range(n_threads)]
+
+    vloss = validate(loader_valid)
+    best_vloss = vloss
+    best_epoch = 0
+    all_losses = []
+    all_vlosses = []
+    # convergence history: (wall time, epoch, validation loss)
+    history = [(0.0, -1, vloss)]
+    lr = train_options.init_lr
+    start_time = time.time()
+
+    try:
+        for epoch in range(0, train_options.n_epochs + 1):
+            losses = [None] * n_threads
+            threads = [threading.Thread(target=_worker, args=(replicas[k], optimizers[k], loaders[k],
+                                                              options['device'], losses, k))
+                       for k in range(n_threads)]
+            for thread in threads:
+                thread.start()
+            for thread in threads:
+                thread.join()
+            # the traceback of a failed thread is printed by the thread itself
+            failed = [k for k in range(n_threads) if losses[k] is None]
+            if failed:
+                raise Exception("Hogwild training failed in thread(s) {}".format(failed))
+
+            # validate every n epochs
+            if epoch % train_options.test_every == 0:
+                vloss = validate(loader_valid)
+                loss = sum(l for l, _ in losses) / sum(n for _, n in losses)
+                all_losses += [loss]
+                all_vlosses += [vloss]
+                history.append((time.time() - start_time, epoch, vloss))
+
+                if vloss < best_vloss:
+                    best_vloss = vloss
+                    modelstate.save_model(epoch, vloss, time.time() - start_time, path_general + 'model/',
+                                          file_name_general + '_bestModel.ckpt')
+                    best_epoch = epoch
+
+                print('Hogwild Epoch: [{:5d}/{:5d}], Threads: {:3d}\tLearning rate: {:.2e}\tLoss: {:.3f}'
+                      '\tVal Loss: {:.3f}'.format(epoch, train_options.n_epochs, n_threads, lr, loss, vloss))
+
+                # lr scheduler (same as run_train)
+                if epoch >= train_options.lr_scheduler_nstart:
+                    if len(all_vlosses) > train_options.lr_scheduler_nepochs and \
+                            vloss >= max(all_vlosses[int(-train_options.lr_scheduler_nepochs - 1):-1]):
+                        lr = lr / train_options.lr_scheduler_factor
+                        for optimizer in optimizers:
+                            for param_group in optimizer.param_groups:
+                                param_group['lr'] = lr
+                        print('\nLearning rate adapted! New learning rate {:.3e}\n'.format(lr))
+                if lr < train_options.min_lr:
+                    break
+
+    except KeyboardInterrupt:
+        print('\n')
+        print('-' * 89)
+        print('Exiting from training early')
+        print('-' * 89)
+    finally:
+        torch.set_num_threads(n_torch_threads)
+
+    time_el = time.time() - start_time
+
+    # save the convergence history for comparison with the synchronous training
+    path = path_general + 'data/'
+    if not os.path.exists(path):
+        os.makedirs(path)
+    with open(path + file_name_general + '_hogwild.json', 'w') as f:
+        json.dump({'n_threads': n_threads, 'history': history}, f, indent=1)
+
+    # save data in dictionary
+    train_dict = {'all_losses': all_losses,
+                  'all_vlosses': all_vlosses,
+                  'all_vloss_times': [t for t, _, _ in history[1:]],
+                  'best_epoch': best_epoch,
+                  'total_epoch': epoch,
+                  'train_time': time_el}
+    dataframe.update(train_dict)
+
+    return dataframe
+
+
+def compare_convergence(df_sync, df_hogwild, test_every):
+    # validation loss of both runs over wall time and time to reach the best synchronous validation loss; the times
+    # are measured at every validation (all_vloss_times of run_train and run_train_hogwild)
+    t_sync = df_sync['all_vloss_times']
+    t_hog = df_hogwild['all_vloss_times']
+    target = min(df_sync['all_vlosses'])
+    reached = [t for t, v in zip(t_hog, df_hogwild['all_vlosses']) if v <= target]
+
+    print('{:>8s} {:>10s} {:>14s} {:>10s} {:>14s}'.format('epoch', 'sync t [s]', 'sync vloss', 'hog t [s]',
+                                                          'hogwild vloss'))
+    for k in range(max(len(t_sync), len(t_hog))):
+        sync = (t_sync[k], df_sync['all_vlosses'][k]) if k < len(t_sync) else (float('nan'), float('nan'))
+        hog = (t_hog[k], df_hogwild['all_vlosses'][k]) if k < len(t_hog) else (float('nan'), float('nan'))
+        print('{:8d} {:10.1f} {:14.4f} {:10.1f} {:14.4f}'.format(k * test_every, *sync, *hog))
+    print('Best synchronous vloss {:.4f} after {:.1f}s, hogwild {}'.format(
+        target, t_sync[int(np.argmin(df_sync['all_vlosses']))],
+        'after {:.1f}s'.format(reached[0]) if reached else 'not reached (best {:.4f})'.format(
+            min(df_hogwild['all_vlosses']))))
+
+    return {'sync_best_vloss': target,
+            'hogwild_best_vloss': min(df_hogwild['all_vlosses']),
+            'sync_time': df_sync['train_time'],
+            'hogwild_time': df_hogwild['train_time'],
+            'sync_time_to_best': t_sync[int(np.argmin(df_sync['all_vlosses']))],
+            'hogwild_time_to_target': reached[0] if reached else None}
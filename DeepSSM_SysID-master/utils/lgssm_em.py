@@ -0,0 +1,173 @@
+import numpy as np
+import multiprocessing as mp
+
+"""maximum-likelihood identification of linear Gaussian state-space models
+    x_k+1 = A x_k + B u_k + w_k,  w_k ~ N(0, Q),        y_k = C x_k + v_k,  v_k ~ N(0, R)
+with the expectation-maximization algorithm (Shumway and Stoffer, 1982). The E-step is a Kalman filter and a
+Rauch-Tung-Striebel smoother, the M-step has a closed form. The covariance recursions do not depend on the data and
+converge to their stationary values after a few steps, afterwards only the means are propagated.
+EM converges to a local maximum, hence several restarts from random initial models run in parallel processes and the
+one with the largest likelihood is kept. The identified A, B, C, Q, R are used directly with run_kalman_filter of
+utils/kalman_filter.py. Data are given as ndarrays of shape (n_channels, k_max)."""
+
+
+def kalman_smoother(A, B, C, Q, R, mu0, P0, u, y, tol=1e-10):
+    # returns the smoothed means (nx, k_max), covariances (k_max, nx, nx), lag-one covariances Cov(x_k+1, x_k|y)
+    # (k_max - 1, nx, nx) and the log-likelihood log p(y_1:k_max)
+    nx = A.shape[0]
+    ny, k_max = y.shape
+
+    # allocation
+    m_pred = np.zeros([nx, k_max])
+    m_filt = np.zeros([nx, k_max])
+    P_pred = np.zeros([k_max, nx, nx])
+    P_filt = np.zeros([k_max, nx, nx])
+
+    # %% Kalman filter
+    loglike = -0.5 * ny * k_max * np.log(2 * np.pi)
+    m = mu0
+    P = P0
+    # index from which on the covariances are stationary
+    k_conv = k_max
+    for k in range(k_max):
+        if k < k_conv:
+            S = C.dot(P).dot(C.T) + R
+            S_inv = np.linalg.inv(S)
+            K = P.dot(C.T).dot(S_inv)
+            P_f = P - K.dot(C).dot(P)
+            logdet = np.linalg.slogdet(S)[1]
+        m_pred[:, k] = m
+        P_pred[k] = P
+
+        # measurement update
+        innov = y[:, k] - C.dot(m)
+        m = m + K.dot(innov)
+        loglike -= 0.5 * (logdet + innov.dot(S_inv).dot(innov))
+        m_filt[:, k] = m
+        P_filt[k] = P_f
+
+        # time update
+        m = A.dot(m) + B.dot(u[:, k])
+        if k < k_conv:
+            P_next = A.dot(P_f).dot(A.T) + Q
+            if np.max(np.abs(P_next - P)) < tol:
+                k_conv = k + 1
+            P = P_next
+
+    # %% RTS smoother
+    m_smooth = np.zeros([nx, k_max])
+    P_smooth = np.zeros([k_max, nx, nx])
+    P_lag = np.zeros([k_max - 1, nx, nx])
+    m_smooth[:, -1] = m_filt[:, -1]
+    P_smooth[-1] = P_filt[-1]
+    J = None
+    smooth_conv = False
+    for k in range(k_max - 2, -1, -1):
+        if k < k_conv or J is None:
+            J = P_filt[k].dot(A.T).dot(np.linalg.inv(P_pred[k + 1]))
+        m_smooth[:, k] = m_filt[:, k] + J.dot(m_smooth[:, k + 1] - m_pred[:, k + 1])
+        if k >= k_conv and smooth_conv:
+            P_smooth[k] = P_smooth[k + 1]
+        else:
+            P_smooth[k] = P_filt[k] + J.dot(P_smooth[k + 1] - P_pred[k + 1]).dot(J.T)
+            smooth_conv = k >= k_conv and np.max(np.abs(P_smooth[k] - P_smooth[k + 1])) < tol
+        P_lag[k] = P_smooth[k + 1].dot(J.T)
+
+    return m_smooth, P_smooth, P_lag, loglike
+
+
+def maximization_step(u, y, m_smooth, P_smooth, P_lag):
+    # closed form maximizer of the expected complete-data log-likelihood
+    nx, k_max = m_smooth.shape
+    x0 = m_smooth[:, :-1]
+    x1 = m_smooth[:, 1:]
+    u0 = u[:, :-1]
+
+    # sufficient statistics
+    Sxx = P_smooth.sum(0) + m_smooth.dot(m_smooth.T)
+    Sxx0 = P_smooth[:-1].sum(0) + x0.dot(x0.T)
+    Sxx1 = P_smooth[1:].sum(0) + x1.dot(x1.T)
+    Sx1x0 = P_lag.sum(0) + x1.dot(x0.T)
+
+    # state equation: [A B] and Q
+    Szz = np.block([[Sxx0, x0.dot(u0.T)], [u0.dot(x0.T), u0.dot(u0.T)]])
+    Sx1z = np.hstack([Sx1x0, x1.dot(u0.T)])
+    AB = np.linalg.solve(Szz, Sx1z.T).T
+    A = AB[:, :nx]
+    B = AB[:, nx:]
+    Q = (Sxx1 - AB.dot(Sx1z.T)) / (k_max - 1)
+
+    # output equation: C and R
+    C = np.linalg.solve(Sxx, m_smooth.dot(y.T)).T
+    R = (y.dot(y.T) - C.dot(m_smooth).dot(y.T)) / k_max
+
+    # initial state
+    mu0 = m_smooth[:, 0]
+    P0 = P_smooth[0]
+
+    return A, B, C, (Q + Q.T) / 2, (R + R.T) / 2, mu0, (P0 + P0.T) / 2
+
+
+def identify_lgssm(u, y, nx, n_iter=200, tol=1e-6, seed=0):
+    # single EM run from a random stable initial model
+    nu = u.shape[0]
+    ny = y.shape[0]
+    rng = np.random.RandomState(seed)
+    A = rng.randn(nx, nx)
+    A = 0.9 * A / np.max(np.abs(np.linalg.eigvals(A)))
+    B = rng.randn(nx, nu)
+    C = rng.randn(ny, nx)
+    Q = np.identity(nx)
+    R = np.diag(np.var(y, axis=1))
+    mu0 = np.zeros(nx)
+    P0 = np.identity(nx)
+
+    all_loglike = []
+    for i in range(n_iter):
+        # E-step
+        m_smooth, P_smooth, P_lag, loglike = kalman_smoother(A, B, C, Q, R, mu0, P0, u, y)
+        all_loglike.append(loglike)
+        if i > 0 and abs(loglike - all_loglike[-2]) < tol * abs(all_loglike[-2]):
+            break
+        # M-step
+        A, B, C, Q, R, mu0, P0 = maximization_step(u, y, m_smooth, P_smooth, P_lag)
+
+    return {'A': A, 'B': B, 'C': C, 'Q': Q, 'R': R, 'mu0': mu0, 'P0': P0,
+            'loglike': all_loglike[-1], 'all_loglike': all_loglike, 'seed': seed}
+
+
+def _identify_job(args):
+    return identify_lgssm(*args)
+
+
+def run_em_restarts(u, y, nx, n_restarts=8, n_workers=None, n_iter=200, tol=1e-6, seed=0):
+    # parallel EM runs from different initial models, returns the one with the largest log-likelihood
+    jobs = [(u, y, nx, n_iter, tol, seed + r) for r in range(n_restarts)]
+    n_workers = min(n_restarts, mp.cpu_count()) if n_workers is None else n_workers
+    if n_workers > 1:
+        with mp.get_context('fork').Pool(n_workers) as pool:
+            results = pool.map(_identify_job, jobs)
+    else:
+        results = [_identify_job(job) for job in jobs]
+    for result in results:
+        print('EM restart {:3d}: {:4d} iterations, log-likelihood {:.3f}'.format(
+            result['seed'] - seed, len(result['all_loglike']), result['loglike']))
+    return max(results, key=lambda result: result['loglike'])
+
+
+# %% evaluation of the identified model
+def simulate_lgssm(A, B, C, u):
+    # open loop (noise free) output of the model, u: (nu, k_max); returns y: (ny, k_max)
+    x = np.zeros(A.shape[0])
+    y = np.zeros([C.shape[0], u.shape[-1]])
+    for k in range(u.shape[-1]):
+        y[:, k] = C.dot(x)
+        x = A.dot(x) + B.dot(u[:, k])
+    return y
+
+
+def output_std(A, C, Q, R):
+    # stationary open-loop std of the output, P solves P = A P A^T + Q
+    nx = A.shape[0]
+    P = np.linalg.solve(np.identity(nx * nx) - np.kron(A, A), Q.reshape(-1)).reshape(nx, nx)
+    return np.sqrt(np.diag(C.dot(P).dot(C.T) + R))
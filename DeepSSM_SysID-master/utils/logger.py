@@ -1,22 +1,179 @@
 # https://stackoverflow.com/questions/14906764/how-to-redirect-stdout-to-both-file-and-console-with-scripting
 import sys
 import os
+import atexit
+import json
+import multiprocessing.util
+import queue
+import signal
+import threading
+import time
 
+"""stdout and stderr are written to the terminal and to a log file. The printing thread only puts the text into a queue,
+a writer thread collects everything that is queued every write_interval seconds, writes it with one call per file and
+flushes the files every flush_interval seconds. Besides the text, log_record() stores structured records (e.g. epoch,
+batch, lr, loss) as json lines in <file_name>_records.jsonl. At exit and on SIGINT / SIGTERM the queue is written and the
+files are flushed before the previous handler runs, such that nothing printed before is lost. Threads do not survive
+fork: the queue is written before the process is forked, forked children (data parallel ranks, ASHA workers) start
+their own writer thread on the same files and write everything when they exit."""
 
-def set_redirects(logdir, file_name):
-    sys.stdout = Logger(logdir, file_name, sys.stdout)
-    sys.stderr = Logger(logdir, file_name, sys.stderr)
+
+class LogWriter(object):
+    def __init__(self, logdir, file_name, flush_interval=1., write_interval=0.1):
+        self.files = {'log': open(os.path.join(logdir, file_name + '.log'), 'a'),
+                      'records': open(os.path.join(logdir, file_name + '_records.jsonl'), 'a')}
+        self.flush_interval = flush_interval
+        self.write_interval = write_interval
+        self.queue = queue.SimpleQueue()
+        # the queue is only emptied under the lock, hence the texts keep their order if the signal handler writes
+        self.lock = threading.RLock()
+        self.stop = threading.Event()
+        self.closed = False
+        self.thread = threading.Thread(target=self._run, daemon=True)
+        self.thread.start()
+        multiprocessing.util.register_after_fork(self, LogWriter._register_finalizer)
+
+    def put(self, name, text):
+        self.queue.put((name, text))
+
+    def _write(self):
+        # everything queued so far, one write per file
+        with self.lock:
+            if self.closed:
+                return
+            texts = {}
+            while True:
+                try:
+                    name, text = self.queue.get_nowait()
+                except queue.Empty:
+                    break
+                texts.setdefault(name, []).append(text)
+            for name, text in texts.items():
+                self.files[name].write(''.join(text))
+
+    def flush(self):
+        with self.lock:
+            self._write()
+            if not self.closed:
+                for file in self.files.values():
+                    file.flush()
+
+    def _run(self):
+        last_flush = time.time()
+        while not self.stop.wait(self.write_interval):
+            self._write()
+            if time.time() - last_flush >= self.flush_interval:
+                self.flush()
+                last_flush = time.time()
+
+    def _before_fork(self):
+        # nothing is queued, buffered or locked while the process is forked
+        self.lock.acquire()
+        self._write()
+        if not self.closed:
+            for file in self.files.values():
+                file.flush()
+
+    def _after_fork_in_parent(self):
+        self.lock.release()
+
+    def _after_fork_in_child(self):
+        # the writer thread of the parent does not exist in the child, the files are shared (append mode)
+        self.lock = threading.RLock()
+        self.queue = queue.SimpleQueue()
+        self.stop = threading.Event()
+        if not self.closed:
+            self.thread = threading.Thread(target=self._run, daemon=True)
+            self.thread.start()
+
+    def _register_finalizer(self):
+        # multiprocessing children end with os._exit (no atexit) but run their finalizers; called by multiprocessing
+        # in the child after its finalizer registry is reset
+        multiprocessing.util.Finalize(self, self.close, exitpriority=10)
+
+    def close(self):
+        if self.closed:
+            return
+        self.stop.set()
+        self.thread.join()
+        with self.lock:
+            self.flush()
+            self.closed = True
+            for file in self.files.values():
+                file.close()
+
+
+# writer of the current run, set by set_redirects
+_writer = None
+
+
+def set_redirects(logdir, file_name, flush_interval=1.):
+    global _writer
+    if _writer is not None:
+        _writer.close()
+    _writer = LogWriter(logdir, file_name, flush_interval)
+    sys.stdout = Logger(_writer, sys.stdout if not isinstance(sys.stdout, Logger) else sys.stdout.terminal)
+    sys.stderr = Logger(_writer, sys.stderr if not isinstance(sys.stderr, Logger) else sys.stderr.terminal)
+    atexit.register(_writer.close)
+    _install_signal_handlers()
+
+
+def log_record(**fields):
+    # structured record of the run, e.g. log_record(epoch=epoch, batch=i, lr=lr, loss=loss)
+    if _writer is not None:
+        fields['time'] = time.time()
+        _writer.put('records', json.dumps(fields) + '\n')
+
+
+def _before_fork():
+    if _writer is not None:
+        _writer._before_fork()
+
+
+def _after_fork_in_parent():
+    if _writer is not None:
+        _writer._after_fork_in_parent()
+
+
+def _after_fork_in_child():
+    if _writer is not None:
+        _writer._after_fork_in_child()
+
+
+os.register_at_fork(before=_before_fork, after_in_parent=_after_fork_in_parent, after_in_child=_after_fork_in_child)
+
+
+def _install_signal_handlers():
+    for signum in (signal.SIGINT, signal.SIGTERM):
+        previous = signal.getsignal(signum)
+        if getattr(previous, 'flushes_log', False):
+            continue
+
+        def handler(signum, frame, previous=previous):
+            if _writer is not None:
+                _writer.flush()
+            if callable(previous):
+                previous(signum, frame)
+            elif previous == signal.SIG_DFL:
+                signal.signal(signum, signal.SIG_DFL)
+                os.kill(os.getpid(), signum)
+
+        handler.flushes_log = True
+        try:
+            signal.signal(signum, handler)
+        except ValueError:
+            # not in the main thread
+            pass
 
 
 class Logger(object):
-    def __init__(self, logdir, file_name, std):
+    def __init__(self, writer, std):
         self.terminal = std
-        self.log = open(os.path.join(logdir, file_name + '.log'), 'a')
+        self.writer = writer
 
     def write(self, message):
         self.terminal.write(message)
-        self.log.write(message)
+        self.writer.put('log', message)
 
     def flush(self):
-        self.log.flush()
-
+        self.terminal.flush()
@@ -0,0 +1,148 @@
+import resource
+import contextlib
+import torch
+import torch.nn as nn
+
+"""memory usage per training phase. Scopes (dataset, normalizer, forward, backward, validation, test) record the peak
+resident set size reached inside them, tags (dataset, model_params, optimizer_state, activations, eval_buffers) record
+the live tensor bytes attributed to them. The activations are counted with the autograd saved tensor hooks, i.e. the
+bytes kept alive for the backward pass. On cuda devices the peak of the caching allocator is recorded as well.
+The peak RSS per scope uses the reset of VmHWM through /proc/self/clear_refs (Linux >= 4.0), otherwise the process
+peak is used."""
+
+_PROC_STATUS = '/proc/self/status'
+_PROC_CLEAR_REFS = '/proc/self/clear_refs'
+
+
+def tensor_bytes(tensors):
+    return sum(t.numel() * t.element_size() for t in tensors if torch.is_tensor(t))
+
+
+def read_rss():
+    # current and peak resident set size in bytes
+    try:
+        with open(_PROC_STATUS, 'r') as f:
+            status = dict(line.split(':', 1) for line in f if ':' in line)
+        return int(status['VmRSS'].split()[0]) * 1024, int(status['VmHWM'].split()[0]) * 1024
+    except (OSError, KeyError):
+        peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss * 1024
+        return peak, peak
+
+
+def reset_peak_rss():
+    try:
+        with open(_PROC_CLEAR_REFS, 'w') as f:
+            f.write('5')
+    except OSError:
+        pass
+
+
+class MemoryTracker(object):
+    def __init__(self):
+        self.enabled = False
+        self._stack = []
+        self.scopes = {}
+        self.tags = {}
+
+    def enable(self, enabled=True):
+        self.enabled = enabled
+
+    def reset(self):
+        self._stack = []
+        self.scopes = {}
+        self.tags = {}
+
+    def track(self, tag, nbytes):
+        # live bytes attributed to a tag and their peak
+        if not self.enabled:
+            return
+        entry = self.tags.setdefault(tag, {'live': 0, 'peak': 0})
+        entry['live'] = nbytes
+        entry['peak'] = max(entry['peak'], nbytes)
+
+    def track_model(self, modelstate):
+        if not self.enabled:
+            return
+        self.track('model_params', tensor_bytes(modelstate.model.parameters()) +
+                   tensor_bytes(modelstate.model.buffers()))
+        self.track('optimizer_state', tensor_bytes(t for state in modelstate.optimizer.state.values()
+                                                   for t in state.values()))
+
+    def track_loaders(self, loaders):
+        # datasets which keep their data as arrays in .u / .y (IODataset, MultiTrajectoryDataset)
+        if not self.enabled:
+            return
+        self.track('dataset', sum(getattr(x, 'nbytes', 0) for loader in loaders
+                                  for x in (getattr(loader.dataset, 'u', None), getattr(loader.dataset, 'y', None))))
+
+    @contextlib.contextmanager
+    def scope(self, name, activations=False):
+        if not self.enabled:
+            yield
+            return
+
+        # propagate the peak so far to the outer scopes and restart the peak measurement
+        _, peak = read_rss()
+        for frame in self._stack:
+            frame['peak'] = max(frame['peak'], peak)
+        reset_peak_rss()
+        rss, _ = read_rss()
+        frame = {'name': name, 'start': rss, 'peak': rss}
+        self._stack.append(frame)
+        if torch.cuda.is_available():
+            torch.cuda.reset_peak_memory_stats()
+
+        # count the tensors saved for backward (activations), parameters are tracked separately
+        saved = {}
+
+        def pack(t):
+            if not isinstance(t, nn.Parameter):
+                saved[t.data_ptr()] = t.numel() * t.element_size()
+            return t
+
+        def unpack(t):
+            return t
+
+        try:
+            if activations:
+                with torch.autograd.graph.saved_tensors_hooks(pack, unpack):
+                    yield
+            else:
+                yield
+        finally:
+            rss, peak = read_rss()
+            self._stack.pop()
+            frame['peak'] = max(frame['peak'], peak)
+            for outer in self._stack:
+                outer['peak'] = max(outer['peak'], frame['peak'])
+
+            entry = self.scopes.setdefault(name, {'calls': 0, 'peak_rss': 0, 'delta_rss': 0, 'peak_cuda': 0})
+            entry['calls'] += 1
+            entry['peak_rss'] = max(entry['peak_rss'], frame['peak'])
+            entry['delta_rss'] = max(entry['delta_rss'], frame['peak'] - frame['start'])
+            if torch.cuda.is_available():
+                entry['peak_cuda'] = max(entry['peak_cuda'], torch.cuda.max_memory_allocated())
+            if activations:
+                self.track('activations', sum(saved.values()))
+
+    def summary(self):
+        return {'scopes': dict(self.scopes), 'tags': dict(self.tags)}
+
+    def print_summary(self, title):
+        if not self.enabled:
+            return
+        mb = 1024 ** 2
+        print('\nMemory usage {}'.format(title))
+        print('{:>18s} {:>8s} {:>16s} {:>16s} {:>16s}'.format('scope', 'calls', 'peak RSS [MB]', 'growth [MB]',
+                                                               'peak cuda [MB]'))
+        for name, s in self.scopes.items():
+            print('{:>18s} {:8d} {:16.1f} {:16.1f} {:16.1f}'.format(name, s['calls'], s['peak_rss'] / mb,
+                                                                    s['delta_rss'] / mb, s['peak_cuda'] / mb))
+        print('{:>18s} {:>8s} {:>16s} {:>16s}'.format('tag', '', 'live [MB]', 'peak [MB]'))
+        for name, s in self.tags.items():
+            print('{:>18s} {:>8s} {:16.1f} {:16.1f}'.format(name, '', s['live'] / mb, s['peak'] / mb))
+        print('')
+
+
+# process wide tracker, enabled by options['memtrack'] in the main files
+memtracker = MemoryTracker()
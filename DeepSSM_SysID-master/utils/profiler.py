@@ -0,0 +1,135 @@
+import os
+import json
+import time
+import threading
+from collections import deque
+import numpy as np
+import torch.nn as nn
+
+"""low-overhead step profiler for the recurrent models. Forward hooks are registered on every nn.Sequential and GRU block
+(phi_*, enc, prior, dec, rnn, ...) and the loss methods (KLD, log-likelihood) are wrapped on the model instance. Nothing
+is registered as long as the profiler is not attached, hence a disabled profiler does not cost anything.
+Timestamps are taken from time.perf_counter_ns (clock_gettime(CLOCK_MONOTONIC), which is read from the TSC through the
+vDSO on x86 Linux) and stored in a fixed size ring buffer per thread."""
+
+# model methods which are no nn.Modules but should be timed as well
+TIMED_METHODS = ['kld_gauss', 'loglikelihood_gauss', 'loglikelihood_gmm', '_kld_gauss', '_nll_bernoulli', '_nll_gauss']
+
+
+class StepProfiler(object):
+    def __init__(self, capacity=2 ** 18):
+        # number of events kept per thread, older events are overwritten
+        self.capacity = capacity
+        self._local = threading.local()
+        self._lock = threading.Lock()
+        self._buffers = []
+        self._handles = []
+        self._patched = []
+
+    @property
+    def attached(self):
+        return len(self._handles) > 0 or len(self._patched) > 0
+
+    def _thread_state(self):
+        state = getattr(self._local, 'state', None)
+        if state is None:
+            # ring buffer of (name, start, end) events and stack of open scopes
+            state = (deque(maxlen=self.capacity), [])
+            with self._lock:
+                self._buffers.append((threading.get_ident(), state[0]))
+            self._local.state = state
+        return state
+
+    def _pre_hook(self, name):
+        def hook(module, inputs):
+            self._thread_state()[1].append(time.perf_counter_ns())
+        return hook
+
+    def _post_hook(self, name):
+        def hook(module, inputs, output):
+            end = time.perf_counter_ns()
+            buffer, stack = self._thread_state()
+            buffer.append((name, stack.pop(), end))
+        return hook
+
+    def _timed(self, name, fn):
+        def wrapper(*args, **kwargs):
+            start = time.perf_counter_ns()
+            result = fn(*args, **kwargs)
+            self._thread_state()[0].append((name, start, time.perf_counter_ns()))
+            return result
+        return wrapper
+
+    def attach(self, model):
+        # attach to the submodules of the model (works for DynamicModel and for the bare models)
+        if self.attached:
+            self.detach()
+        for full_name, module in model.named_modules():
+            name = full_name.split('.')[-1]
+            # time all feature extractors, encoder, prior, decoder and recurrence blocks
+            if isinstance(module, (nn.Sequential, nn.RNNBase)):
+                self._handles.append(module.register_forward_pre_hook(self._pre_hook(name)))
+                self._handles.append(module.register_forward_hook(self._post_hook(name)))
+            # time the loss computations
+            for method in TIMED_METHODS:
+                if hasattr(module, method):
+                    setattr(module, method, self._timed(method, getattr(module, method)))
+                    self._patched.append((module, method))
+
+    def detach(self):
+        for handle in self._handles:
+            handle.remove()
+        for module, method in self._patched:
+            delattr(module, method)
+        self._handles = []
+        self._patched = []
+
+    def reset(self):
+        with self._lock:
+            for _, buffer in self._buffers:
+                buffer.clear()
+
+    def events(self):
+        with self._lock:
+            return [(tid, name, start, end) for tid, buffer in self._buffers for (name, start, end) in list(buffer)]
+
+    def summary(self):
+        # aggregate statistics and log2 histogram (in ns) per block
+        durations = {}
+        for _, name, start, end in self.events():
+            durations.setdefault(name, []).append(end - start)
+
+        summary = {}
+        for name, values in durations.items():
+            values = np.asarray(values, dtype=np.int64)
+            bins = np.floor(np.log2(np.maximum(values, 1))).astype(np.int64)
+            hist = np.bincount(bins)
+            summary[name] = {'count': int(values.size),
+                             'total_ns': int(values.sum()),
+                             'mean_ns': float(values.mean()),
+                             'min_ns': int(values.min()),
+                             'p50_ns': float(np.percentile(values, 50)),
+                             'p99_ns': float(np.percentile(values, 99)),
+                             'max_ns': int(values.max()),
+                             'hist_log2_ns': {int(2 ** b): int(c) for b, c in enumerate(hist) if c > 0}}
+        return summary
+
+    def print_summary(self):
+        summary = self.summary()
+        total = sum(s['total_ns'] for s in summary.values())
+        print('{:>20s} {:>10s} {:>12s} {:>12s} {:>12s} {:>7s}'.format('block', 'calls', 'mean [us]', 'p99 [us]',
+                                                                      'total [ms]', 'share'))
+        for name, s in sorted(summary.items(), key=lambda item: -item[1]['total_ns']):
+            print('{:>20s} {:10d} {:12.2f} {:12.2f} {:12.2f} {:6.1f}%'.format(name, s['count'], s['mean_ns'] / 1e3,
+                                                                            s['p99_ns'] / 1e3, s['total_ns'] / 1e6,
+                                                                            100. * s['total_ns'] / max(total, 1)))
+
+    def save_chrome_trace(self, path, file_name):
+        # trace can be opened with chrome://tracing or https://ui.perfetto.dev
+        if not os.path.exists(path):
+            os.makedirs(path)
+        pid = os.getpid()
+        trace = [{'name': name, 'ph': 'X', 'ts': start / 1e3, 'dur': (end - start) / 1e3, 'pid': pid, 'tid': tid}
+                 for tid, name, start, end in self.events()]
+        with open(os.path.join(path, file_name), 'w') as f:
+            json.dump({'traceEvents': trace, 'displayTimeUnit': 'ns'}, f)
@@ -0,0 +1,77 @@
+import atexit
+import pickle
+import multiprocessing as mp
+import queue
+import traceback
+
+"""figure rendering in a background process. Plot functions of utils/datavisualizer.py (or any module level function)
+are handed over together with their arguments through a bounded queue. The job is pickled in submit() (the queue
+itself pickles later in its feeder thread), hence the renderer works on a snapshot taken at the time of the call and
+the caller may continue to change its data right away.
+The renderer process only writes figures (Agg backend), with options['showfig'] the figure has to be shown on the main
+thread and the plot function is called directly. The queue is drained when the program exits."""
+
+
+def _render_loop(jobs):
+    import matplotlib.pyplot as plt
+    plt.switch_backend('Agg')
+    while True:
+        job = jobs.get()
+        if job is None:
+            break
+        function, args, kwargs = pickle.loads(job)
+        try:
+            function(*args, **kwargs)
+        except Exception:
+            traceback.print_exc()
+        plt.close('all')
+
+
+class FigureRenderer(object):
+    def __init__(self, max_backlog=8, block=True):
+        # max_backlog: number of figures waiting in the queue, if it is full submit waits (block=True) or the figure is
+        # dropped (block=False)
+        ctx = mp.get_context('fork')
+        self.jobs = ctx.Queue(max_backlog)
+        self.block = block
+        self.n_dropped = 0
+        self.process = ctx.Process(target=_render_loop, args=(self.jobs,), daemon=True)
+        self.process.start()
+
+    def submit(self, function, *args, **kwargs):
+        try:
+            # snapshot now, not when the feeder thread of the queue gets to it
+            self.jobs.put(pickle.dumps((function, args, kwargs)), block=self.block)
+        except queue.Full:
+            self.n_dropped += 1
+
+    def close(self):
+        # waits until all submitted figures are written
+        if self.process.is_alive():
+            self.jobs.put(None)
+            self.process.join()
+        if self.n_dropped > 0:
+            print('FigureRenderer: {} figures dropped (backlog full)'.format(self.n_dropped))
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+
+# renderer shared by all callers of render(), started with the first figure
+_renderer = None
+
+
+def render(options, function, *args, **kwargs):
+    # calls function(*args, **kwargs) in the background renderer, or directly if the figure is shown
+    global _renderer
+    if options['showfig']:
+        return function(*args, **kwargs)
+    if not options['savefig']:
+        return None
+    if _renderer is None:
+        _renderer = FigureRenderer()
+        atexit.register(_renderer.close)
+    _renderer.submit(function, *args, **kwargs)
@@ -0,0 +1,206 @@
+import os
+import json
+import fcntl
+import contextlib
+import numpy as np
+
+"""append-only columnar store for the results of grid searches and Monte Carlo sweeps. A store is a directory with
+schema.json and one binary file per column: fixed size columns (e.g. 'i4', 'f8', 'S32') hold one value per row,
+variable length columns ('f8[]', e.g. the loss curves) a data file and the end offset of every row (<name>.idx).
+Appending a run writes its bytes to the end of every column file under an exclusive file lock, hence parallel workers
+can append to the same store. A row only counts once all its columns are written, a run which crashed while
+appending is cut away by the next append. Readers map the columns with np.memmap and only touch the columns they
+filter on or ask for. Columns added to the schema later are appended to an existing store with default values."""
+
+# schema of a training / test run (options, losses and metrics)
+RUN_SCHEMA = {
+    'run_id': 'S32',  # one id per invocation of an experiment, separates reruns in the same logdir
+    'dataset': 'S32',
+    'model': 'S16',
+    'h_dim': 'i4',
+    'z_dim': 'i4',
+    'n_layers': 'i4',
+    'seq_len_train': 'i8',
+    'batch_size': 'i4',
+    'lr_scheduler_nepochs': 'i4',
+    'lr_scheduler_factor': 'f8',
+    'model_param': 'i8',
+    'k_max_train': 'i8',
+    'mc_iter': 'i4',
+    'best_epoch': 'i4',
+    'total_epoch': 'i4',
+    'train_time': 'f8',
+    'marginal_likeli': 'f8',
+    'vaf': 'f8',
+    'rmse': 'f8',  # first output, as in all_rmse of the experiments
+    'all_losses': 'f8[]',
+    'all_vlosses': 'f8[]',
+}
+
+
+class ResultsStore(object):
+    def __init__(self, path, schema=None):
+        self.path = path
+        schema_file = os.path.join(path, 'schema.json')
+        if os.path.isfile(schema_file):
+            with open(schema_file, 'r') as file:
+                self.schema = json.load(file)
+            required = RUN_SCHEMA if schema is None else schema
+            if any(self.schema.get(name, dtype) != dtype for name, dtype in required.items()):
+                raise Exception("Schema does not match the existing store: {}".format(path))
+            if any(name not in self.schema for name in required):
+                self._extend(required)
+        else:
+            self.schema = RUN_SCHEMA if schema is None else schema
+            os.makedirs(path, exist_ok=True)
+            with self._locked():
+                if not os.path.isfile(schema_file):
+                    with open(schema_file, 'w') as file:
+                        json.dump(self.schema, file, indent=1)
+
+    def _file(self, name, ext='.bin'):
+        return os.path.join(self.path, name + ext)
+
+    @staticmethod
+    def _is_var(dtype):
+        return dtype.endswith('[]')
+
+    @contextlib.contextmanager
+    def _locked(self):
+        with open(os.path.join(self.path, '.lock'), 'a') as lock:
+            fcntl.flock(lock, fcntl.LOCK_EX)
+            try:
+                yield
+            finally:
+                fcntl.flock(lock, fcntl.LOCK_UN)
+
+    def _rows(self, name, dtype):
+        if self._is_var(dtype):
+            file = self._file(name, '.idx')
+            itemsize = 8
+        else:
+            file = self._file(name)
+            itemsize = np.dtype(dtype).itemsize
+        return os.path.getsize(file) // itemsize if os.path.isfile(file) else 0
+
+    def _extend(self, schema):
+        # add the missing columns of schema to an existing store, the existing rows get the default values
+        with self._locked():
+            with open(os.path.join(self.path, 'schema.json'), 'r') as file:
+                self.schema = json.load(file)
+            n_rows = len(self)
+            for name, dtype in schema.items():
+                if name in self.schema:
+                    continue
+                if self._is_var(dtype):
+                    open(self._file(name), 'wb').close()
+                    with open(self._file(name, '.idx'), 'wb') as file:
+                        file.write(np.zeros(n_rows, dtype=np.int64).tobytes())
+                else:
+                    default = {'f': np.nan, 'S': b''}.get(np.dtype(dtype).kind, 0)
+                    with open(self._file(name), 'wb') as file:
+                        file.write(np.full(n_rows, default, dtype=dtype).tobytes())
+                self.schema[name] = dtype
+            with open(os.path.join(self.path, 'schema.json'), 'w') as file:
+                json.dump(self.schema, file, indent=1)
+
+    def __len__(self):
+        # number of complete rows
+        return min(self._rows(name, dtype) for name, dtype in self.schema.items())
+
+    def _offsets(self, name, n_rows):
+        if n_rows == 0:
+            return np.zeros(0, dtype=np.int64)
+        return np.memmap(self._file(name, '.idx'), dtype=np.int64, mode='r', shape=(n_rows,))
+
+    def append(self, row):
+        # row: dict column -> value, missing columns get 0 / nan / empty, columns not in the schema are ignored
+        with self._locked():
+            n_rows = len(self)
+            for name, dtype in self.schema.items():
+                if self._is_var(dtype):
+                    offsets = self._offsets(name, n_rows)
+                    end = int(offsets[-1]) if n_rows > 0 else 0
+                    value = np.asarray(row.get(name, []), dtype=dtype[:-2]).reshape(-1)
+                    # cut a partly written row away
+                    with open(self._file(name), 'ab') as file:
+                        file.truncate(end * value.itemsize)
+                        file.write(value.tobytes())
+                    with open(self._file(name, '.idx'), 'ab') as file:
+                        file.truncate(n_rows * 8)
+                        file.write(np.int64(end + value.size).tobytes())
+                else:
+                    default = {'f': np.nan, 'S': b''}.get(np.dtype(dtype).kind, 0)
+                    value = row.get(name, default)
+                    if isinstance(value, str):
+                        value = value.encode()
+                    value = np.asarray(value, dtype=dtype)
+                    with open(self._file(name), 'ab') as file:
+                        file.truncate(n_rows * value.itemsize)
+                        file.write(value.tobytes())
+
+    def column(self, name, n_rows=None):
+        # fixed size column: memmap of all rows, variable length column: list of arrays
+        n_rows = len(self) if n_rows is None else n_rows
+        dtype = self.schema[name]
+        if self._is_var(dtype):
+            offsets = np.concatenate([[0], self._offsets(name, n_rows)])
+            if offsets[-1] == 0:
+                return [np.zeros(0, dtype=dtype[:-2]) for _ in range(n_rows)]
+            data = np.memmap(self._file(name), dtype=dtype[:-2], mode='r', shape=(int(offsets[-1]),))
+            return [data[offsets[k]:offsets[k + 1]] for k in range(n_rows)]
+        if n_rows == 0:
+            return np.zeros(0, dtype=dtype)
+        return np.memmap(self._file(name), dtype=dtype, mode='r', shape=(n_rows,))
+
+    def scan(self, where=None, columns=None):
+        # where: dict column -> value or list of values (all must match); returns dict column -> values of the rows
+        n_rows = len(self)
+        mask = np.ones(n_rows, dtype=bool)
+        for name, values in (where or {}).items():
+            values = values if isinstance(values, (list, tuple)) else [values]
+            values = [value.encode() if isinstance(value, str) else value for value in values]
+            mask &= np.isin(self.column(name, n_rows), values)
+        idx = np.flatnonzero(mask)
+        result = {}
+        for name in (self.schema if columns is None else columns):
+            values = self.column(name, n_rows)
+            result[name] = [values[k] for k in idx] if self._is_var(self.schema[name]) else np.asarray(values[idx])
+        return result
+
+    def grid(self, value, axes, where=None):
+        # values of one metric on the grid spanned by the columns in axes, e.g. grid('vaf', ('h_dim', 'z_dim')) for
+        # plot_perf_gridsearch; returns the array (nan where no run exists, runs on the same point are averaged) and
+        # the values of every axis
+        data = self.scan(where, [value] + list(axes))
+        axis_values = [np.unique(data[axis]) for axis in axes]
+        idx = tuple(np.searchsorted(values, data[axis]) for values, axis in zip(axis_values, axes))
+        shape = tuple(len(values) for values in axis_values)
+        total = np.zeros(shape)
+        count = np.zeros(shape)
+        np.add.at(total, idx, data[value])
+        np.add.at(count, idx, 1)
+        with np.errstate(invalid='ignore'):
+            return total / count, axis_values
+
+
+def run_row(options, df, **kwargs):
+    # row of RUN_SCHEMA from the options and the dataframe of run_train / run_test, kwargs e.g. k_max_train, mc_iter
+    row = {'run_id': options.get('run_id', ''),
+           'dataset': options['dataset'],
+           'model': options['model'],
+           'h_dim': options['model_options'].h_dim,
+           'z_dim': options['model_options'].z_dim,
+           'n_layers': options['model_options'].n_layers,
+           'seq_len_train': options['dataset_options'].seq_len_train or 0,
+           'batch_size': options['train_options'].batch_size,
+           'lr_scheduler_nepochs': options['train_options'].lr_scheduler_nepochs,
+           'lr_scheduler_factor': options['train_options'].lr_scheduler_factor}
+    for name in ('model_param', 'best_epoch', 'total_epoch', 'train_time', 'marginal_likeli', 'vaf',
+                 'all_losses', 'all_vlosses'):
+        if name in df:
+            row[name] = df[name]
+    if 'rmse' in df:
+        row['rmse'] = np.asarray(df['rmse']).reshape(-1)[0]
+    row.update(kwargs)
+    return row
@@ -23,12 +23,26 @@ def compute_normalizer(loader_train):
     y_mean = 0
     u_var = 0
     y_var = 0
-    for i, (u, y) in enumerate(loader_train):
+
+    def moments(x, w):
+        # batch mean of the mean and variance along time of every slot, without the padding (w = 0) of
+        # multi-trajectory batches
+        if w is None:
+            return torch.mean(x, dim=(0, 2)), torch.mean(torch.var(x, dim=2, unbiased=False), dim=(0,))
+        n = w.sum(dim=2).clamp(min=1)
+        mean = (x * w).sum(dim=2) / n
+        var = (w * (x - mean.unsqueeze(2)) ** 2).sum(dim=2) / n
+        return mean.mean(0), var.mean(0)
+
+    for i, (u, y, *mask) in enumerate(loader_train):
+        w = (mask[0] > 0).to(u.dtype).unsqueeze(1) if mask else None
         total_batches += u.size()[0]
-        u_mean += torch.mean(u, dim=(0, 2))
-        y_mean += torch.mean(y, dim=(0, 2))
-        u_var += torch.mean(torch.var(u, dim=2, unbiased=False), dim=(0,))
-        y_var += torch.mean(torch.var(y, dim=2, unbiased=False), dim=(0,))
+        u_mean_i, u_var_i = moments(u, w)
+        y_mean_i, y_var_i = moments(y, w)
+        u_mean += u_mean_i
+        y_mean += y_mean_i
+        u_var += u_var_i
+        y_var += y_var_i
 
     u_mean = u_mean.numpy()
     y_mean = y_mean.numpy()